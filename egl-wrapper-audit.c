@@ -0,0 +1,313 @@
+// This file is an rtld-audit module (see rtld-audit(7)) for using
+// egl-wrapper with zero overhead on the calls which are not hooked.
+//
+// The wrapper is preloaded as usual (libegl-wrapper.so and the library
+// containing the hooks), so that it interposes the EGL symbols. When
+// loaded with LD_AUDIT as well, this module rebinds every EGL symbol which
+// is not listed in EGL_WRAPPER_AUDIT_HOOKS straight to the wrapped libEGL.
+// Only the listed symbols still go through the wrapper. For example, run
+// the application with this environment:
+//
+//   LD_PRELOAD="/path/to/libegl-wrapper.so /path/to/my/hooks.so"
+//   LD_AUDIT=/path/to/libegl-wrapper-audit.so
+//   EGL_WRAPPER_AUDIT_HOOKS=eglSwapBuffers,eglMakeCurrent
+//
+// Binding happens before the hooks are registered, so the list must be
+// given up front. The wrapped libEGL is the one named by EGL_TO_WRAP
+// (by path, file name or soname), or else the first loaded libEGL.so*
+// which is not built on egl-wrapper. If EGL_TO_WRAP lists several
+// libraries, nothing is rebound, as the calls need to be routed.
+// It has to be loaded when the application binds its EGL symbols
+// (e.g. because the application links to it); symbols bound before that
+// keep going through the wrapper.
+//
+// Note that the wrapper only sees the calls which are hooked. Features
+// which depend on other calls (such as routing several libraries, which
+// needs eglMakeCurrent) need those to be listed as well.
+//
+// The module runs in its own link namespace, so it doesn't link to
+// egl-wrapper and only uses libc.
+
+#define _GNU_SOURCE
+
+#include <link.h>
+#include <elf.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_AUDIT_HOOKS 64
+
+#if __ELF_NATIVE_CLASS == 64
+#define SYMBOL_TYPE(sym) ELF64_ST_TYPE((sym)->st_info)
+#else
+#define SYMBOL_TYPE(sym) ELF32_ST_TYPE((sym)->st_info)
+#endif
+
+// Types
+typedef struct {
+    ElfW(Addr) base;
+    const ElfW(Sym)* symtab;
+    const char* strtab;
+    const uint32_t* gnu_hash;
+    const uint32_t* sysv_hash;
+    const char* soname;     // NULL if the object has none
+} elf_symbols;
+
+// Globals
+static char g_hooks[MAX_AUDIT_HOOKS][64];
+static unsigned int g_num_hooks = 0;
+static const char* g_wrapped_paths = NULL;   // EGL_TO_WRAP
+
+static bool g_disabled = false;
+static struct link_map* g_wrapped = NULL;
+static elf_symbols g_wrapped_symbols;
+
+static _Atomic unsigned long g_rebound = 0;
+static _Atomic unsigned long g_kept = 0;
+
+static bool is_hooked(const char* name) {
+    for(unsigned int i = 0; i < g_num_hooks; i++) {
+        if(strcmp(g_hooks[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Pointers in the dynamic section are relocated by the dynamic linker
+// on most architectures, but not all.
+static const void* dynamic_pointer(const struct link_map* map, ElfW(Addr) ptr) {
+    return (const void*)(ptr < map->l_addr ? ptr + map->l_addr : ptr);
+}
+
+static bool read_symbols(const struct link_map* map, elf_symbols* symbols) {
+    memset(symbols, 0, sizeof(*symbols));
+    symbols->base = map->l_addr;
+    ElfW(Addr) soname_offset = 0;
+    bool have_soname = false;
+    for(const ElfW(Dyn)* dyn = map->l_ld; dyn != NULL && dyn->d_tag != DT_NULL; dyn++) {
+        switch(dyn->d_tag) {
+        case DT_SYMTAB:
+            symbols->symtab = dynamic_pointer(map, dyn->d_un.d_ptr);
+            break;
+        case DT_STRTAB:
+            symbols->strtab = dynamic_pointer(map, dyn->d_un.d_ptr);
+            break;
+        case DT_GNU_HASH:
+            symbols->gnu_hash = dynamic_pointer(map, dyn->d_un.d_ptr);
+            break;
+        case DT_HASH:
+            symbols->sysv_hash = dynamic_pointer(map, dyn->d_un.d_ptr);
+            break;
+        case DT_SONAME:
+            soname_offset = dyn->d_un.d_val;
+            have_soname = true;
+            break;
+        }
+    }
+    if(have_soname && symbols->strtab != NULL) {
+        symbols->soname = symbols->strtab + soname_offset;
+    }
+    return symbols->symtab != NULL && symbols->strtab != NULL &&
+        (symbols->gnu_hash != NULL || symbols->sysv_hash != NULL);
+}
+
+static bool symbol_matches(const elf_symbols* symbols, uint32_t index, const char* name) {
+    const ElfW(Sym)* sym = &symbols->symtab[index];
+    return sym->st_shndx != SHN_UNDEF && sym->st_value != 0 &&
+        SYMBOL_TYPE(sym) == STT_FUNC &&
+        strcmp(symbols->strtab + sym->st_name, name) == 0;
+}
+
+// Address of a function defined by an object, or 0. Undefined symbols
+// (references to functions of other objects) never match.
+static uintptr_t find_symbol(const elf_symbols* symbols, const char* name) {
+    if(symbols->gnu_hash != NULL) {
+        uint32_t hash = 5381;
+        for(const char* c = name; *c != '\0'; c++) {
+            hash = hash * 33 + (unsigned char)*c;
+        }
+        const uint32_t* table = symbols->gnu_hash;
+        uint32_t num_buckets = table[0];
+        uint32_t sym_offset = table[1];
+        uint32_t bloom_size = table[2];
+        const ElfW(Addr)* bloom = (const ElfW(Addr)*)&table[4];
+        const uint32_t* buckets = (const uint32_t*)&bloom[bloom_size];
+        const uint32_t* chain = &buckets[num_buckets];
+
+        uint32_t index = buckets[hash % num_buckets];
+        if(index < sym_offset) {
+            return 0;
+        }
+        for(;; index++) {
+            uint32_t chain_hash = chain[index - sym_offset];
+            if((chain_hash | 1) == (hash | 1) && symbol_matches(symbols, index, name)) {
+                return symbols->base + symbols->symtab[index].st_value;
+            }
+            if(chain_hash & 1) {
+                return 0;
+            }
+        }
+    }
+
+    uint32_t hash = 0;
+    for(const char* c = name; *c != '\0'; c++) {
+        hash = (hash << 4) + (unsigned char)*c;
+        uint32_t high = hash & 0xf0000000;
+        if(high != 0) {
+            hash ^= high >> 24;
+        }
+        hash &= ~high;
+    }
+    const uint32_t* table = symbols->sysv_hash;
+    uint32_t num_buckets = table[0];
+    const uint32_t* buckets = &table[2];
+    const uint32_t* chain = &buckets[num_buckets];
+    for(uint32_t index = buckets[hash % num_buckets]; index != STN_UNDEF; index = chain[index]) {
+        if(symbol_matches(symbols, index, name)) {
+            return symbols->base + symbols->symtab[index].st_value;
+        }
+    }
+    return 0;
+}
+
+static const char* file_name(const char* path) {
+    const char* name = strrchr(path, '/');
+    return name != NULL ? name + 1 : path;
+}
+
+// Whether an EGL_TO_WRAP entry names the object at path: the same path,
+// or the same file name or soname when the entry is a bare name.
+static bool names_library(const char* entry, size_t entry_len, const char* path, const char* soname) {
+    if(strlen(path) == entry_len && strncmp(path, entry, entry_len) == 0) {
+        return true;
+    }
+    if(memchr(entry, '/', entry_len) != NULL) {
+        // Paths may differ in form (e.g. through symbolic links), compare
+        // their file names.
+        const char* name = entry + entry_len;
+        while(name > entry && name[-1] != '/') {
+            name--;
+        }
+        entry_len -= (size_t)(name - entry);
+        entry = name;
+    }
+    const char* path_name = file_name(path);
+    return (strlen(path_name) == entry_len && strncmp(path_name, entry, entry_len) == 0) ||
+        (soname != NULL && strlen(soname) == entry_len && strncmp(soname, entry, entry_len) == 0);
+}
+
+static bool is_wrapped_library(const char* path, const char* soname) {
+    if(g_wrapped_paths == NULL) {
+        return strncmp(file_name(path), "libEGL.so", 9) == 0;
+    }
+    const char* entry = g_wrapped_paths;
+    for(;;) {
+        size_t len = strcspn(entry, ":");
+        if(len > 0 && names_library(entry, len, path, soname)) {
+            return true;
+        }
+        if(entry[len] == '\0') {
+            return false;
+        }
+        entry += len + 1;
+    }
+}
+
+// egl-wrapper defines egl_wrapper_initialize, and each library built on
+// it (which may well be named libEGL.so) egl_wrapper_first_contact.
+static bool is_built_on_wrapper(const elf_symbols* symbols) {
+    return find_symbol(symbols, "egl_wrapper_initialize") != 0 ||
+        find_symbol(symbols, "egl_wrapper_first_contact") != 0;
+}
+
+unsigned int la_version(unsigned int version) {
+    const char* hooks = getenv("EGL_WRAPPER_AUDIT_HOOKS");
+    if(hooks != NULL) {
+        char* list = strdup(hooks);
+        char* save = NULL;
+        for(char* name = strtok_r(list, ",:", &save); name != NULL; name = strtok_r(NULL, ",:", &save)) {
+            if(g_num_hooks == MAX_AUDIT_HOOKS) {
+                fprintf(stderr, "Too many audit hooks, ignoring %s\n", name);
+                continue;
+            }
+            snprintf(g_hooks[g_num_hooks++], sizeof(g_hooks[0]), "%s", name);
+        }
+        free(list);
+    }
+    g_wrapped_paths = getenv("EGL_TO_WRAP");
+    if(g_wrapped_paths != NULL && strchr(g_wrapped_paths, ':') != NULL) {
+        fprintf(stderr, "egl-wrapper audit: several wrapped EGL libraries, EGL symbols are not rebound\n");
+        g_wrapped_paths = NULL;
+        g_disabled = true;
+    }
+
+    // Refuse to audit (rather than misbehave) with an older interface.
+    return version < LAV_CURRENT ? 0 : LAV_CURRENT;
+}
+
+unsigned int la_objopen(struct link_map* map, Lmid_t lmid, uintptr_t* cookie) {
+    (void)cookie;
+    if(lmid != LM_ID_BASE) {
+        return 0;
+    }
+    elf_symbols symbols;
+    if(g_wrapped == NULL && !g_disabled && read_symbols(map, &symbols) &&
+        is_wrapped_library(map->l_name, symbols.soname) && !is_built_on_wrapper(&symbols)) {
+        g_wrapped_symbols = symbols;
+        g_wrapped = map;
+    }
+    return LA_FLG_BINDTO | LA_FLG_BINDFROM;
+}
+
+unsigned int la_objclose(uintptr_t* cookie) {
+    if(g_wrapped != NULL && (struct link_map*)*cookie == g_wrapped) {
+        g_wrapped = NULL;
+    }
+    return 0;
+}
+
+static uintptr_t bind_symbol(uintptr_t value, uintptr_t* defcook, const char* symname) {
+    // Calls within the wrapped library, hooked calls and everything
+    // which isn't EGL keep the normal binding.
+    if(g_wrapped == NULL || (struct link_map*)*defcook == g_wrapped ||
+        strncmp(symname, "egl", 3) != 0 || is_hooked(symname)) {
+        return value;
+    }
+    uintptr_t direct = find_symbol(&g_wrapped_symbols, symname);
+    if(direct == 0) {
+        // E.g. egl_wrapper_* functions.
+        g_kept++;
+        return value;
+    }
+    g_rebound++;
+    return direct;
+}
+
+#if __ELF_NATIVE_CLASS == 64
+uintptr_t la_symbind64(Elf64_Sym* sym, unsigned int ndx, uintptr_t* refcook,
+    uintptr_t* defcook, unsigned int* flags, const char* symname) {
+    (void)ndx;
+    (void)refcook;
+    (void)flags;
+    return bind_symbol(sym->st_value, defcook, symname);
+}
+#else
+uintptr_t la_symbind32(Elf32_Sym* sym, unsigned int ndx, uintptr_t* refcook,
+    uintptr_t* defcook, unsigned int* flags, const char* symname) {
+    (void)ndx;
+    (void)refcook;
+    (void)flags;
+    return bind_symbol(sym->st_value, defcook, symname);
+}
+#endif
+
+static void __attribute__((destructor)) report(void) {
+    if(getenv("EGL_WRAPPER_AUDIT_VERBOSE") != NULL) {
+        fprintf(stderr, "egl-wrapper audit: %lu symbol(s) bound to the wrapped EGL, %lu kept\n",
+            (unsigned long)g_rebound, (unsigned long)g_kept);
+    }
+}
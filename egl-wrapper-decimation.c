@@ -0,0 +1,136 @@
+// This file implements frame decimation: forwarding only a subset of
+// eglSwapBuffers calls and replacing the others by a flush.
+
+#include "egl-wrapper-internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Number of surfaces for which we keep separate frame counters.
+// If more surfaces are swapped, the least recently swapped one is evicted.
+#define MAX_TRACKED_SURFACES 32
+
+// Types
+typedef struct {
+    EGLSurface surface;
+    // Swaps since the last forwarded one, so that frames held back by
+    // the rate limit don't shift the every-nth cadence.
+    unsigned long long frames_since_present;
+    uint64_t last_present_ns;
+    uint64_t last_swap_ns;
+} surface_state;
+
+// Globals
+_Atomic bool g_decimation_enabled = false;
+
+static unsigned int g_every_nth = 1;
+static uint64_t g_min_present_interval_ns = 0;
+static surface_state g_surfaces[MAX_TRACKED_SURFACES];
+static pthread_mutex_t g_surfaces_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Atomic unsigned long long g_presented = 0;
+static _Atomic unsigned long long g_skipped = 0;
+
+// glFlush of each wrapped library. Threads may resolve it concurrently,
+// and store the same pointer.
+static void (*_Atomic g_glFlush[MAX_EGL_LIBRARIES])(void);
+static _Atomic bool g_glFlush_resolved[MAX_EGL_LIBRARIES];
+
+void egl_wrapper_set_frame_decimation(unsigned int every_nth, double max_present_hz) {
+    pthread_mutex_lock(&g_surfaces_lock);
+    g_every_nth = every_nth == 0 ? 1 : every_nth;
+    g_min_present_interval_ns = max_present_hz > 0.0 ?
+        (uint64_t)(1e9 / max_present_hz) : 0;
+    g_decimation_enabled = g_every_nth > 1 || g_min_present_interval_ns > 0;
+    pthread_mutex_unlock(&g_surfaces_lock);
+}
+
+void egl_wrapper_get_decimation_stats(egl_wrapper_decimation_stats* stats) {
+    stats->presented = atomic_load(&g_presented);
+    stats->skipped = atomic_load(&g_skipped);
+}
+
+void decimation_init_from_env(void) {
+    const char* every_nth = getenv("EGL_WRAPPER_PRESENT_EVERY_NTH");
+    const char* max_hz = getenv("EGL_WRAPPER_MAX_PRESENT_HZ");
+
+    if(every_nth == NULL && max_hz == NULL) {
+        return;
+    }
+
+    unsigned int n = every_nth != NULL ? (unsigned int)strtoul(every_nth, NULL, 10) : 1;
+    double hz = max_hz != NULL ? strtod(max_hz, NULL) : 0.0;
+    egl_wrapper_set_frame_decimation(n, hz);
+    printf("Frame decimation: presenting every %u frame(s), max %.1f Hz\n", g_every_nth, hz);
+}
+
+// Find the state for a surface, or claim the least recently used slot.
+// Must be called with g_surfaces_lock held.
+static surface_state* lookup_surface(EGLSurface surface) {
+    surface_state* lru = &g_surfaces[0];
+    for(int i = 0; i < MAX_TRACKED_SURFACES; i++) {
+        if(g_surfaces[i].surface == surface) {
+            return &g_surfaces[i];
+        }
+        if(g_surfaces[i].last_swap_ns < lru->last_swap_ns) {
+            lru = &g_surfaces[i];
+        }
+    }
+    lru->surface = surface;
+    lru->frames_since_present = 0;
+    lru->last_present_ns = 0;
+    lru->last_swap_ns = 0;
+    return lru;
+}
+
+bool decimation_should_present(EGLSurface surface) {
+    uint64_t now = egl_wrapper_now_ns();
+    bool present;
+
+    pthread_mutex_lock(&g_surfaces_lock);
+    surface_state* state = lookup_surface(surface);
+    // The first frame of a surface is always presented.
+    present = state->last_present_ns == 0 || state->frames_since_present + 1 >= g_every_nth;
+    if(present && g_min_present_interval_ns > 0 && state->last_present_ns != 0) {
+        present = now - state->last_present_ns >= g_min_present_interval_ns;
+    }
+    state->last_swap_ns = now;
+    if(present) {
+        state->frames_since_present = 0;
+        state->last_present_ns = now;
+    } else {
+        state->frames_since_present++;
+    }
+    pthread_mutex_unlock(&g_surfaces_lock);
+
+    atomic_fetch_add(present ? &g_presented : &g_skipped, 1);
+    return present;
+}
+
+EGLBoolean decimation_skip_swap(void) {
+    // glFlush is resolved lazily, because the client API library may
+    // not be loaded yet when the wrapper is initialized.
+    egl_dispatch_table* library = dispatch_for_thread();
+    if(!atomic_load(&g_glFlush_resolved[library->index])) {
+        atomic_store(&g_glFlush[library->index], (void (*)(void))library->eglGetProcAddress("glFlush"));
+        atomic_store(&g_glFlush_resolved[library->index], true);
+    }
+    void (*flush)(void) = atomic_load(&g_glFlush[library->index]);
+    if(flush != NULL) {
+        flush();
+    }
+    return EGL_TRUE;
+}
+
+void decimation_forget_surface(EGLSurface surface) {
+    pthread_mutex_lock(&g_surfaces_lock);
+    for(int i = 0; i < MAX_TRACKED_SURFACES; i++) {
+        if(g_surfaces[i].surface == surface) {
+            g_surfaces[i].surface = EGL_NO_SURFACE;
+            g_surfaces[i].last_swap_ns = 0;
+        }
+    }
+    pthread_mutex_unlock(&g_surfaces_lock);
+}
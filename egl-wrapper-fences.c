@@ -0,0 +1,540 @@
+// This file implements the fences inserted at eglSwapBuffers, and the
+// background thread which measures GPU completion of frames with them.
+
+#include "egl-wrapper-internal.h"
+
+#include <EGL/eglext.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Maximum number of surfaces with fences pending at once, and of fences
+// pending per surface. If the GPU falls further behind, frames are not
+// timed until it catches up.
+#define MAX_FENCED_SURFACES 32
+#define MAX_PENDING_FENCES 32
+
+// Number of displays for which support of EGL_KHR_fence_sync is cached.
+#define MAX_CHECKED_DISPLAYS 8
+
+// How long the background thread waits on a fence at once, so that it
+// never sits inside the driver indefinitely (e.g. on a lost context).
+#define POLL_TIMEOUT_NS 2000000ull
+
+// Types
+// Fence entry points of one wrapped library.
+typedef struct {
+    PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR;
+    PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR;
+    PFNEGLCLIENTWAITSYNCKHRPROC eglClientWaitSyncKHR;
+    _Atomic bool resolved;
+} fence_procs;
+
+typedef struct {
+    fence_procs* procs;
+    EGLDisplay dpy;
+    EGLSyncKHR sync;
+    unsigned long long frame;
+    uint64_t submit_ns;
+} pending_fence;
+
+// Pending fences of one surface, oldest at head. A queue without fences
+// which isn't claimed is free for any surface.
+typedef struct {
+    EGLSurface surface;
+    pending_fence fences[MAX_PENDING_FENCES];
+    unsigned int head;
+    unsigned int count;
+    // Set while a thread waits on the head fence without holding g_lock.
+    // Only the thread which claimed it may retire it.
+    bool claimed;
+} fence_queue;
+
+// A fence taken out of its queue. Destroying it and reporting its frame
+// are done once g_lock is released.
+typedef struct {
+    fence_procs* procs;
+    EGLDisplay dpy;
+    EGLSyncKHR sync;    // EGL_NO_SYNC_KHR if there is nothing to destroy
+    bool completed;
+    egl_wrapper_gpu_frame_info info;
+} retired_fence;
+
+typedef struct {
+    EGLDisplay dpy;
+    fence_procs* procs; // NULL if the display doesn't support fences
+} checked_display;
+
+// Globals
+_Atomic bool g_fences_enabled = false;
+
+static bool g_gpu_timing_enabled = false;
+static unsigned int g_max_frames_in_flight = 0;
+
+static fence_procs g_fence_procs[MAX_EGL_LIBRARIES];
+
+static checked_display g_checked_displays[MAX_CHECKED_DISPLAYS];
+static unsigned int g_num_checked_displays = 0;
+
+static fence_queue g_queues[MAX_FENCED_SURFACES];
+static unsigned long long g_next_frame = 0;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+// Signaled when a fence is queued or a queue is unclaimed by a render
+// thread, for the background thread.
+static pthread_cond_t g_fence_queued = PTHREAD_COND_INITIALIZER;
+// Broadcast when fences are retired or a queue is unclaimed, for the
+// render threads waiting in the limiter.
+static pthread_cond_t g_fences_retired = PTHREAD_COND_INITIALIZER;
+static unsigned int g_limiter_waiters = 0;
+
+static pthread_t g_poll_thread;
+static bool g_poll_thread_running = false;
+
+static void (*g_timing_callback)(const egl_wrapper_gpu_frame_info*) = NULL;
+static egl_wrapper_gpu_timing_stats g_stats;
+static double g_total_latency_ms = 0.0;
+
+static unsigned long long g_throttled_swaps = 0;
+static uint64_t g_throttle_ns = 0;
+
+// Must be called without g_lock held, as it calls into the driver.
+static fence_procs* resolve_fence_procs(egl_dispatch_table* library) {
+    fence_procs* procs = &g_fence_procs[library->index];
+    if(!atomic_load(&procs->resolved)) {
+        PFNEGLCREATESYNCKHRPROC create = (PFNEGLCREATESYNCKHRPROC)library->eglGetProcAddress("eglCreateSyncKHR");
+        PFNEGLDESTROYSYNCKHRPROC destroy = (PFNEGLDESTROYSYNCKHRPROC)library->eglGetProcAddress("eglDestroySyncKHR");
+        PFNEGLCLIENTWAITSYNCKHRPROC wait = (PFNEGLCLIENTWAITSYNCKHRPROC)library->eglGetProcAddress("eglClientWaitSyncKHR");
+        if(create == NULL || destroy == NULL || wait == NULL) {
+            fprintf(stderr, "EGL_KHR_fence_sync entry points not found, GPU fences disabled\n");
+            create = NULL;
+        }
+        pthread_mutex_lock(&g_lock);
+        if(!atomic_load(&procs->resolved)) {
+            procs->eglCreateSyncKHR = create;
+            procs->eglDestroySyncKHR = destroy;
+            procs->eglClientWaitSyncKHR = wait;
+            atomic_store(&procs->resolved, true);
+        }
+        pthread_mutex_unlock(&g_lock);
+    }
+    return procs->eglCreateSyncKHR != NULL ? procs : NULL;
+}
+
+static bool has_extension(const char* extensions, const char* name) {
+    size_t len = strlen(name);
+    const char* p = extensions;
+    while(p != NULL && (p = strstr(p, name)) != NULL) {
+        if((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+        p += len;
+    }
+    return false;
+}
+
+// Returns the fence entry points for a display, or NULL if it doesn't
+// support fences.
+// Must be called without g_lock held: checking a new display calls into
+// the driver, which must not block other render threads.
+static fence_procs* display_fence_procs(EGLDisplay dpy) {
+    pthread_mutex_lock(&g_lock);
+    unsigned int num_checked = g_num_checked_displays < MAX_CHECKED_DISPLAYS ?
+        g_num_checked_displays : MAX_CHECKED_DISPLAYS;
+    for(unsigned int i = 0; i < num_checked; i++) {
+        if(g_checked_displays[i].dpy == dpy) {
+            fence_procs* procs = g_checked_displays[i].procs;
+            pthread_mutex_unlock(&g_lock);
+            return procs;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    // Threads checking the same display at once get the same result.
+    egl_dispatch_table* library = dispatch_for_display(dpy);
+    fence_procs* procs = resolve_fence_procs(library);
+    if(procs != NULL && !has_extension(library->eglQueryString(dpy, EGL_EXTENSIONS), "EGL_KHR_fence_sync")) {
+        procs = NULL;
+    }
+
+    pthread_mutex_lock(&g_lock);
+    checked_display* checked = &g_checked_displays[g_num_checked_displays++ % MAX_CHECKED_DISPLAYS];
+    checked->dpy = dpy;
+    checked->procs = procs;
+    pthread_mutex_unlock(&g_lock);
+    return procs;
+}
+
+// The queue of a surface, or NULL if it has none. With create, a free
+// queue is given to the surface if needed, and NULL is only returned if
+// there is none left.
+// Must be called with g_lock held.
+static fence_queue* find_queue(EGLSurface surface, bool create) {
+    fence_queue* free_queue = NULL;
+    for(unsigned int i = 0; i < MAX_FENCED_SURFACES; i++) {
+        fence_queue* queue = &g_queues[i];
+        bool is_free = queue->count == 0 && !queue->claimed;
+        if(queue->surface == surface && !is_free) {
+            return queue;
+        }
+        if(is_free && (free_queue == NULL || queue->surface == surface)) {
+            free_queue = queue;
+        }
+    }
+    if(create && free_queue != NULL) {
+        free_queue->surface = surface;
+        free_queue->head = 0;
+        return free_queue;
+    }
+    return NULL;
+}
+
+// The queue whose head fence is the oldest among the unclaimed ones.
+// Must be called with g_lock held.
+static fence_queue* oldest_unclaimed_queue(void) {
+    fence_queue* oldest = NULL;
+    for(unsigned int i = 0; i < MAX_FENCED_SURFACES; i++) {
+        fence_queue* queue = &g_queues[i];
+        if(queue->count != 0 && !queue->claimed && (oldest == NULL ||
+            queue->fences[queue->head].submit_ns < oldest->fences[oldest->head].submit_ns)) {
+            oldest = queue;
+        }
+    }
+    return oldest;
+}
+
+static void pop_head(fence_queue* queue, retired_fence* retired) {
+    pending_fence* fence = &queue->fences[queue->head];
+    retired->procs = fence->procs;
+    retired->dpy = fence->dpy;
+    retired->sync = fence->sync;
+    queue->head = (queue->head + 1) % MAX_PENDING_FENCES;
+    queue->count--;
+}
+
+// Record a completed frame and take its fence out of the queue.
+// Must be called with g_lock held.
+static void retire_head(fence_queue* queue, uint64_t complete_ns, retired_fence* retired) {
+    pending_fence* fence = &queue->fences[queue->head];
+    // If another frame of the same surface was queued by the time this
+    // one completed, the CPU was ahead of the GPU.
+    bool gpu_bound = queue->count > 1;
+    double latency_ms = (double)(complete_ns - fence->submit_ns) / 1e6;
+
+    g_stats.frames++;
+    if(gpu_bound) {
+        g_stats.gpu_bound_frames++;
+    } else {
+        g_stats.cpu_bound_frames++;
+    }
+    g_stats.last_latency_ms = latency_ms;
+    g_total_latency_ms += latency_ms;
+    g_stats.avg_latency_ms = g_total_latency_ms / (double)g_stats.frames;
+    if(latency_ms > g_stats.max_latency_ms) {
+        g_stats.max_latency_ms = latency_ms;
+    }
+
+    retired->completed = true;
+    retired->info.frame = fence->frame;
+    retired->info.surface = queue->surface;
+    retired->info.submit_ns = fence->submit_ns;
+    retired->info.complete_ns = complete_ns;
+    retired->info.gpu_bound = gpu_bound;
+    pop_head(queue, retired);
+}
+
+// Destroy a retired fence and report its frame to callback, if any.
+// Must be called without g_lock held.
+static void finish_retired(const retired_fence* retired, void (*callback)(const egl_wrapper_gpu_frame_info*)) {
+    if(retired->sync != EGL_NO_SYNC_KHR) {
+        retired->procs->eglDestroySyncKHR(retired->dpy, retired->sync);
+    }
+    if(retired->completed && callback != NULL) {
+        callback(&retired->info);
+    }
+}
+
+// Wait on the head fence of a queue for at most timeout_ns, with g_lock
+// released during the wait, and take it out of the queue if it signaled
+// (or became invalid). The caller must have checked that the queue is not
+// claimed, and must pass retired to finish_retired once g_lock is
+// released.
+// Must be called with g_lock held. Returns the EGL wait result.
+static EGLint wait_on_head(fence_queue* queue, EGLTimeKHR timeout_ns, retired_fence* retired) {
+    pending_fence* fence = &queue->fences[queue->head];
+    fence_procs* procs = fence->procs;
+    EGLDisplay dpy = fence->dpy;
+    EGLSyncKHR sync = fence->sync;
+
+    queue->claimed = true;
+    pthread_mutex_unlock(&g_lock);
+    EGLint result = procs->eglClientWaitSyncKHR(dpy, sync, 0, timeout_ns);
+    uint64_t now = egl_wrapper_now_ns();
+    pthread_mutex_lock(&g_lock);
+    // Only a claimed queue can't be retired from by others, so the fence
+    // is still its head.
+    queue->claimed = false;
+
+    retired->sync = EGL_NO_SYNC_KHR;
+    retired->completed = false;
+    if(result == EGL_CONDITION_SATISFIED_KHR) {
+        retire_head(queue, now, retired);
+    } else if(result == EGL_FALSE) {
+        // The fence became invalid (e.g. the display was terminated), so
+        // it can't be destroyed either.
+        g_stats.dropped_frames++;
+        pop_head(queue, retired);
+        retired->sync = EGL_NO_SYNC_KHR;
+    }
+
+    // A fence which timed out changes nothing for the limiter, except that
+    // the queue can be claimed again.
+    if(result != EGL_TIMEOUT_EXPIRED_KHR || g_limiter_waiters > 0) {
+        pthread_cond_broadcast(&g_fences_retired);
+    }
+    if(!g_poll_thread_running || !pthread_equal(pthread_self(), g_poll_thread)) {
+        pthread_cond_signal(&g_fence_queued);
+    }
+    return result;
+}
+
+// Retire the head fence of each unclaimed queue which already signaled.
+// Must be called with g_lock held, from the background thread.
+static void poll_all_queues(void) {
+    for(unsigned int i = 0; i < MAX_FENCED_SURFACES; i++) {
+        fence_queue* queue = &g_queues[i];
+        retired_fence retired;
+        while(queue->count != 0 && !queue->claimed &&
+            wait_on_head(queue, 0, &retired) != EGL_TIMEOUT_EXPIRED_KHR) {
+            void (*callback)(const egl_wrapper_gpu_frame_info*) = g_timing_callback;
+            pthread_mutex_unlock(&g_lock);
+            finish_retired(&retired, callback);
+            pthread_mutex_lock(&g_lock);
+        }
+    }
+}
+
+static void* poll_thread_main(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_lock);
+    for(;;) {
+        // Fences of other surfaces may complete while waiting on the
+        // oldest one, so check them all between waits.
+        poll_all_queues();
+        fence_queue* queue = oldest_unclaimed_queue();
+        if(queue == NULL) {
+            // Sleeps until a fence is queued, however long that takes.
+            pthread_cond_wait(&g_fence_queued, &g_lock);
+            continue;
+        }
+        retired_fence retired;
+        if(wait_on_head(queue, POLL_TIMEOUT_NS, &retired) != EGL_TIMEOUT_EXPIRED_KHR) {
+            void (*callback)(const egl_wrapper_gpu_frame_info*) = g_timing_callback;
+            pthread_mutex_unlock(&g_lock);
+            finish_retired(&retired, callback);
+            pthread_mutex_lock(&g_lock);
+        }
+    }
+    return NULL;
+}
+
+// Must be called with g_lock held.
+static void update_fences_enabled(void) {
+    g_fences_enabled = g_gpu_timing_enabled || g_max_frames_in_flight > 0;
+}
+
+void egl_wrapper_enable_gpu_timing(bool enable) {
+    pthread_mutex_lock(&g_lock);
+    g_gpu_timing_enabled = enable;
+    if(enable && !g_poll_thread_running) {
+        if(pthread_create(&g_poll_thread, NULL, poll_thread_main, NULL) != 0) {
+            fprintf(stderr, "Failed to start GPU timing thread\n");
+            g_gpu_timing_enabled = false;
+        } else {
+            pthread_detach(g_poll_thread);
+            g_poll_thread_running = true;
+        }
+    }
+    update_fences_enabled();
+    pthread_mutex_unlock(&g_lock);
+}
+
+void egl_wrapper_set_max_frames_in_flight(unsigned int max_frames) {
+    pthread_mutex_lock(&g_lock);
+    // One slot must stay free for the frame being swapped.
+    g_max_frames_in_flight = max_frames < MAX_PENDING_FENCES ? max_frames : MAX_PENDING_FENCES - 1;
+    update_fences_enabled();
+    pthread_cond_broadcast(&g_fences_retired);
+    pthread_mutex_unlock(&g_lock);
+}
+
+void egl_wrapper_get_frame_limiter_stats(egl_wrapper_frame_limiter_stats* stats) {
+    pthread_mutex_lock(&g_lock);
+    stats->max_frames_in_flight = g_max_frames_in_flight;
+    unsigned int deepest = 0;
+    for(unsigned int i = 0; i < MAX_FENCED_SURFACES; i++) {
+        if(g_queues[i].count > deepest) {
+            deepest = g_queues[i].count;
+        }
+    }
+    stats->frames_in_flight = deepest;
+    stats->throttled_swaps = g_throttled_swaps;
+    stats->throttle_time_ms = (double)g_throttle_ns / 1e6;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void egl_wrapper_set_gpu_timing_callback(void (*callback)(const egl_wrapper_gpu_frame_info* info)) {
+    pthread_mutex_lock(&g_lock);
+    g_timing_callback = callback;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void egl_wrapper_get_gpu_timing_stats(egl_wrapper_gpu_timing_stats* stats) {
+    pthread_mutex_lock(&g_lock);
+    *stats = g_stats;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void fences_init_from_env(void) {
+    const char* gpu_timing = getenv("EGL_WRAPPER_GPU_TIMING");
+    if(gpu_timing != NULL && atoi(gpu_timing) != 0) {
+        egl_wrapper_enable_gpu_timing(true);
+        printf("GPU timing enabled\n");
+    }
+
+    const char* max_frames = getenv("EGL_WRAPPER_MAX_FRAMES_IN_FLIGHT");
+    if(max_frames != NULL) {
+        egl_wrapper_set_max_frames_in_flight((unsigned int)strtoul(max_frames, NULL, 10));
+        printf("Max frames in flight: %u\n", g_max_frames_in_flight);
+    }
+}
+
+void fences_before_swap(EGLDisplay dpy, EGLSurface surface) {
+    fence_procs* procs = display_fence_procs(dpy);
+
+    pthread_mutex_lock(&g_lock);
+    unsigned long long frame = g_next_frame++;
+    fence_queue* queue = procs != NULL ? find_queue(surface, true) : NULL;
+    if(queue == NULL || queue->count == MAX_PENDING_FENCES) {
+        g_stats.dropped_frames++;
+        pthread_mutex_unlock(&g_lock);
+        return;
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    // Creating the fence may fail (e.g. no current context). That sets
+    // an EGL error, but the swap which follows overwrites it.
+    EGLSyncKHR sync = procs->eglCreateSyncKHR(dpy, EGL_SYNC_FENCE_KHR, NULL);
+    uint64_t now = egl_wrapper_now_ns();
+
+    pthread_mutex_lock(&g_lock);
+    // The queue may have been emptied and given to another surface since.
+    queue = find_queue(surface, true);
+    if(sync == EGL_NO_SYNC_KHR || queue == NULL || queue->count == MAX_PENDING_FENCES) {
+        g_stats.dropped_frames++;
+        pthread_mutex_unlock(&g_lock);
+        if(sync != EGL_NO_SYNC_KHR) {
+            procs->eglDestroySyncKHR(dpy, sync);
+        }
+        return;
+    }
+    pending_fence* fence = &queue->fences[(queue->head + queue->count) % MAX_PENDING_FENCES];
+    fence->procs = procs;
+    fence->dpy = dpy;
+    fence->sync = sync;
+    fence->frame = frame;
+    fence->submit_ns = now;
+    queue->count++;
+    pthread_cond_signal(&g_fence_queued);
+    pthread_mutex_unlock(&g_lock);
+}
+
+// Number of frames of a surface not known to have completed.
+// Must be called with g_lock held.
+static unsigned int frames_in_flight(EGLSurface surface) {
+    fence_queue* queue = find_queue(surface, false);
+    return queue != NULL ? queue->count : 0;
+}
+
+void fences_after_swap(EGLSurface surface) {
+    pthread_mutex_lock(&g_lock);
+    if(g_max_frames_in_flight == 0) {
+        pthread_mutex_unlock(&g_lock);
+        return;
+    }
+
+    // The limit applies to each surface on its own, so that a GPU-bound
+    // surface never throttles the render threads of other surfaces.
+    // When GPU timing is enabled, the background thread retires all
+    // fences (so that every frame reaches the timing callback) and we
+    // only wait for it. Otherwise, we retire the surface's fences
+    // ourselves, starting with frames which already completed so that
+    // only frames really still in flight count against the limit.
+    bool self_retire = !g_gpu_timing_enabled;
+    retired_fence retired;
+    fence_queue* queue;
+    while(self_retire && (queue = find_queue(surface, false)) != NULL && !queue->claimed &&
+        wait_on_head(queue, 0, &retired) != EGL_TIMEOUT_EXPIRED_KHR) {
+        pthread_mutex_unlock(&g_lock);
+        finish_retired(&retired, NULL);
+        pthread_mutex_lock(&g_lock);
+    }
+
+    if(frames_in_flight(surface) <= g_max_frames_in_flight) {
+        pthread_mutex_unlock(&g_lock);
+        return;
+    }
+
+    uint64_t start = egl_wrapper_now_ns();
+    while(frames_in_flight(surface) > g_max_frames_in_flight) {
+        // Only the oldest fence of this surface is waited on.
+        queue = self_retire ? find_queue(surface, false) : NULL;
+        if(queue == NULL || queue->claimed) {
+            g_limiter_waiters++;
+            pthread_cond_wait(&g_fences_retired, &g_lock);
+            g_limiter_waiters--;
+            continue;
+        }
+        wait_on_head(queue, EGL_FOREVER_KHR, &retired);
+        pthread_mutex_unlock(&g_lock);
+        finish_retired(&retired, NULL);
+        pthread_mutex_lock(&g_lock);
+    }
+    g_throttled_swaps++;
+    g_throttle_ns += egl_wrapper_now_ns() - start;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void fences_forget_surface(EGLSurface surface) {
+    retired_fence dropped[MAX_PENDING_FENCES];
+    unsigned int num_dropped = 0;
+
+    pthread_mutex_lock(&g_lock);
+    fence_queue* queue;
+    // A claimed head is being waited on, and only its claimer may retire
+    // it, so wait for that to finish first.
+    while((queue = find_queue(surface, false)) != NULL && queue->claimed) {
+        g_limiter_waiters++;
+        pthread_cond_wait(&g_fences_retired, &g_lock);
+        g_limiter_waiters--;
+    }
+    if(queue == NULL) {
+        pthread_mutex_unlock(&g_lock);
+        return;
+    }
+    // Its frames can't be presented anymore, so they are dropped rather
+    // than timed, and the queue is free for other surfaces.
+    while(queue->count != 0) {
+        pop_head(queue, &dropped[num_dropped++]);
+    }
+    queue->surface = EGL_NO_SURFACE;
+    g_stats.dropped_frames += num_dropped;
+    pthread_cond_broadcast(&g_fences_retired);
+    pthread_mutex_unlock(&g_lock);
+
+    for(unsigned int i = 0; i < num_dropped; i++) {
+        dropped[i].procs->eglDestroySyncKHR(dropped[i].dpy, dropped[i].sync);
+    }
+}
@@ -0,0 +1,102 @@
+// This file implements the GLVND vendor mode: a library built on
+// egl-wrapper which includes this file (the egl-wrapper-glvnd object
+// library) can be loaded by libglvnd's libEGL as an EGL vendor library,
+// in place of the real vendor (e.g. Mesa's libEGL_mesa.so.0).
+//
+// The real vendor is loaded and initialized through its own __egl_Main,
+// with the same exports and vendor info, so that all objects it creates
+// stay attributed to this vendor. Its imports are passed on to libglvnd,
+// except for getProcAddress: for the functions egl-wrapper implements,
+// libglvnd gets the wrapper's own functions, so a call from the
+// application goes through libglvnd's dispatch, then straight into the
+// hooks. Everything else (EGL 1.5 and extension functions, GL functions)
+// is the real vendor's.
+//
+// The real vendor is named by EGL_WRAPPER_GLVND_VENDOR, and defaults to
+// libEGL_mesa.so.0. The wrapper still has to be initialized by
+// egl_wrapper_first_contact as usual; it then wraps the real vendor,
+// whatever path is passed to egl_wrapper_initialize.
+//
+// Note that libglvnd answers some calls itself, so their hooks are not
+// called in this mode:
+// - eglGetDisplay: displays are created through the vendor's
+//   getPlatformDisplay instead;
+// - eglGetCurrentContext, eglGetCurrentSurface and eglGetCurrentDisplay,
+//   from libglvnd's own current state;
+// - eglGetProcAddress, which only asks vendors for functions it doesn't
+//   know;
+// - eglQueryString(EGL_NO_DISPLAY, ...), for the client extensions, which
+//   it merges from the vendors' getVendorString.
+
+#define _GNU_SOURCE
+
+#include "egl-wrapper-internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <glvnd/libeglabi.h>
+
+// Globals
+static __EGLapiImports g_vendor_imports;
+static void* g_vendor_handle = NULL;
+static void* g_wrapper_handle = NULL;
+
+static void* vendor_lookup(void* ctx, const char* name) {
+    return ((const __EGLapiImports*)ctx)->getProcAddress(name);
+}
+
+// Our own definition of an EGL function, if egl-wrapper implements it.
+// This can't simply take the address of e.g. eglSwapBuffers, which would
+// resolve to the one of libglvnd's libEGL.
+static void* wrapper_proc(const char* name) {
+    if(strncmp(name, "egl", 3) != 0 || name[3] < 'A' || name[3] > 'Z') {
+        return NULL;
+    }
+    return dlsym(g_wrapper_handle, name);
+}
+
+static void* vendor_get_proc_address(const char* name) {
+    void* proc = wrapper_proc(name);
+    return proc != NULL ? proc : g_vendor_imports.getProcAddress(name);
+}
+
+EGLBoolean __egl_Main(uint32_t version, const __EGLapiExports* exports,
+    __EGLvendorInfo* vendor, __EGLapiImports* imports) {
+    const char* vendor_path = getenv("EGL_WRAPPER_GLVND_VENDOR");
+    if(vendor_path == NULL) {
+        vendor_path = "libEGL_mesa.so.0";
+    }
+
+    // dlsym on our own handle only searches libegl-wrapper and its
+    // dependencies, which don't include any libEGL.
+    Dl_info info;
+    if(dladdr((void*)bare_eglGetError, &info) == 0 ||
+        (g_wrapper_handle = dlopen(info.dli_fname, RTLD_LAZY | RTLD_NOLOAD)) == NULL) {
+        fprintf(stderr, "Failed to find libegl-wrapper\n");
+        return EGL_FALSE;
+    }
+
+    g_vendor_handle = dlopen(vendor_path, RTLD_LAZY | RTLD_LOCAL);
+    if(g_vendor_handle == NULL) {
+        fprintf(stderr, "Failed to load GLVND vendor %s: %s\n", vendor_path, dlerror());
+        return EGL_FALSE;
+    }
+    __PFNEGLMAINPROC vendor_main = (__PFNEGLMAINPROC)dlsym(g_vendor_handle, __EGL_MAIN_PROTO_NAME);
+    if(vendor_main == NULL) {
+        fprintf(stderr, "%s is not a GLVND vendor library\n", vendor_path);
+        dlclose(g_vendor_handle);
+        return EGL_FALSE;
+    }
+    if(!vendor_main(version, exports, vendor, imports)) {
+        fprintf(stderr, "GLVND vendor %s failed to initialize\n", vendor_path);
+        dlclose(g_vendor_handle);
+        return EGL_FALSE;
+    }
+
+    g_vendor_imports = *imports;
+    imports->getProcAddress = vendor_get_proc_address;
+    set_wrapped_library_lookup(vendor_path, vendor_lookup, &g_vendor_imports);
+    return EGL_TRUE;
+}
@@ -0,0 +1,576 @@
+// This file implements the latency and failure injection engine: rules,
+// loaded from a file, which make EGL calls slower or make them fail, to
+// test how an application copes with a slow or flaky driver.
+//
+// Rules are checked at the entry of the exported functions, before hooks
+// and the wrapped library. An injected failure returns the function's
+// failure value straight away, and the error is returned by the thread's
+// next eglGetError.
+
+#define _GNU_SOURCE
+
+#include "egl-wrapper-internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#define MAX_RULE_THREADS 8
+#define DEFAULT_SEED 1
+
+// Types
+typedef enum {
+    DELAY_FIXED = 0,
+    DELAY_UNIFORM,
+    DELAY_NORMAL,
+    DELAY_EXPONENTIAL
+} delay_distribution;
+
+typedef struct {
+    char name[16];  // thread name, or "" to match tid
+    int tid;
+} thread_filter;
+
+typedef struct injection_rule {
+    // Next rule for the same entry point.
+    struct injection_rule* next[INJECTION_NUM_ENTRIES];
+    unsigned int line;
+    char text[160];
+
+    // Action: either a delay or an error.
+    EGLint error;
+    delay_distribution distribution;
+    uint64_t delay_a_ns;  // fixed delay, minimum, mean
+    uint64_t delay_b_ns;  // maximum, standard deviation
+
+    // Conditions.
+    thread_filter threads[MAX_RULE_THREADS];
+    unsigned int num_threads;
+    unsigned long long after_frames;
+    unsigned long long for_frames;      // 0 if unlimited
+    unsigned long long every;
+    unsigned long long count;           // 0 if unlimited
+    double probability;
+
+    // Statistics.
+    _Atomic unsigned long long calls;   // calls meeting the frame and thread conditions
+    _Atomic unsigned long long injected;
+    _Atomic unsigned long long delay_ns;
+    _Atomic unsigned long long recoveries;
+    _Atomic unsigned long long recovery_ns;
+    _Atomic unsigned long long max_recovery_ns;
+    struct injection_rule* next_rule;
+} injection_rule;
+
+typedef struct {
+    injection_rule* by_entry[INJECTION_NUM_ENTRIES];
+    injection_rule* rules;
+    char path[4096];
+} rule_set;
+
+// Globals
+_Atomic bool g_injection_enabled = false;
+
+static const char* g_entry_names[INJECTION_NUM_ENTRIES] = {
+#define ENTRY_NAME(F) "egl" #F,
+    EGL_WRAPPER_ENTRIES(ENTRY_NAME)
+#undef ENTRY_NAME
+};
+
+// Rule sets are never freed, as calls may still be going through a
+// replaced one.
+static _Atomic(rule_set*) g_rules = NULL;
+// Successful swaps, over all threads.
+static _Atomic unsigned long long g_frames = 0;
+static uint64_t g_seed = DEFAULT_SEED;
+
+static __thread EGLint t_error = EGL_SUCCESS;
+// Successful swaps of the thread, for after_frames and for_frames.
+static __thread unsigned long long t_frames = 0;
+// Last injected error of the thread, until its next successful swap.
+static __thread injection_rule* t_failed_rule = NULL;
+static __thread uint64_t t_failed_ns = 0;
+
+static const struct {
+    const char* name;
+    EGLint error;
+} g_error_names[] = {
+    { "EGL_NOT_INITIALIZED", EGL_NOT_INITIALIZED },
+    { "EGL_BAD_ACCESS", EGL_BAD_ACCESS },
+    { "EGL_BAD_ALLOC", EGL_BAD_ALLOC },
+    { "EGL_BAD_ATTRIBUTE", EGL_BAD_ATTRIBUTE },
+    { "EGL_BAD_CONFIG", EGL_BAD_CONFIG },
+    { "EGL_BAD_CONTEXT", EGL_BAD_CONTEXT },
+    { "EGL_BAD_CURRENT_SURFACE", EGL_BAD_CURRENT_SURFACE },
+    { "EGL_BAD_DISPLAY", EGL_BAD_DISPLAY },
+    { "EGL_BAD_MATCH", EGL_BAD_MATCH },
+    { "EGL_BAD_NATIVE_PIXMAP", EGL_BAD_NATIVE_PIXMAP },
+    { "EGL_BAD_NATIVE_WINDOW", EGL_BAD_NATIVE_WINDOW },
+    { "EGL_BAD_PARAMETER", EGL_BAD_PARAMETER },
+    { "EGL_BAD_SURFACE", EGL_BAD_SURFACE },
+    { "EGL_CONTEXT_LOST", EGL_CONTEXT_LOST }
+};
+
+// Whether an entry point reports failures through eglGetError, and so
+// can have errors injected.
+static bool can_fail(injection_entry entry) {
+    switch(entry) {
+    case INJECTION_eglGetError:
+    case INJECTION_eglQueryAPI:
+    case INJECTION_eglGetCurrentContext:
+    case INJECTION_eglGetCurrentSurface:
+    case INJECTION_eglGetCurrentDisplay:
+    case INJECTION_eglGetProcAddress:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// The draw-th random number of the call-th call of a rule, a splitmix64
+// hash of those, the rule's line and the seed.
+static double random_unit(const injection_rule* rule, unsigned long long call, unsigned int draw) {
+    uint64_t x = g_seed ^ ((uint64_t)rule->line << 40) ^ ((uint64_t)call << 2) ^ draw;
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return (double)(x >> 11) / (double)(1ull << 53);
+}
+
+static uint64_t sample_delay(const injection_rule* rule, unsigned long long call) {
+    double a = (double)rule->delay_a_ns;
+    double b = (double)rule->delay_b_ns;
+    double ns;
+    switch(rule->distribution) {
+    case DELAY_UNIFORM:
+        ns = a + (b - a) * random_unit(rule, call, 1);
+        break;
+    case DELAY_NORMAL:
+        // Box-Muller, with 1 - u in (0, 1] for the log.
+        ns = a + b * sqrt(-2.0 * log(1.0 - random_unit(rule, call, 1))) * cos(2.0 * M_PI * random_unit(rule, call, 2));
+        break;
+    case DELAY_EXPONENTIAL:
+        ns = -a * log(1.0 - random_unit(rule, call, 1));
+        break;
+    case DELAY_FIXED:
+    default:
+        ns = a;
+        break;
+    }
+    return ns > 0.0 ? (uint64_t)ns : 0;
+}
+
+static bool thread_matches(const injection_rule* rule) {
+    char name[16] = "";
+    int tid = (int)syscall(SYS_gettid);
+    for(unsigned int i = 0; i < rule->num_threads; i++) {
+        const thread_filter* filter = &rule->threads[i];
+        if(filter->name[0] == '\0') {
+            if(filter->tid == tid) {
+                return true;
+            }
+            continue;
+        }
+        if(name[0] == '\0') {
+            prctl(PR_GET_NAME, name, 0, 0, 0);
+        }
+        if(strcmp(filter->name, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether a rule applies to this call, counting it. Sets call to the
+// rule's call count.
+static bool rule_triggers(injection_rule* rule, unsigned long long frame, unsigned long long* call) {
+    if(frame < rule->after_frames ||
+        (rule->for_frames != 0 && frame >= rule->after_frames + rule->for_frames)) {
+        return false;
+    }
+    if(rule->num_threads != 0 && !thread_matches(rule)) {
+        return false;
+    }
+    *call = atomic_fetch_add(&rule->calls, 1) + 1;
+    if(*call % rule->every != 0) {
+        return false;
+    }
+    if(rule->probability < 1.0 && random_unit(rule, *call, 0) >= rule->probability) {
+        return false;
+    }
+    unsigned long long injected = atomic_load(&rule->injected);
+    do {
+        if(rule->count != 0 && injected >= rule->count) {
+            return false;
+        }
+    } while(!atomic_compare_exchange_weak(&rule->injected, &injected, injected + 1));
+    return true;
+}
+
+static void record_recovery(injection_rule* rule, uint64_t ns) {
+    atomic_fetch_add(&rule->recoveries, 1);
+    atomic_fetch_add(&rule->recovery_ns, ns);
+    unsigned long long max = atomic_load(&rule->max_recovery_ns);
+    while(ns > max && !atomic_compare_exchange_weak(&rule->max_recovery_ns, &max, ns)) {
+    }
+}
+
+static void sleep_ns(uint64_t ns) {
+    struct timespec ts = { (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull) };
+    while(clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR) {
+    }
+}
+
+EGLint injection_before_call(injection_entry entry) {
+    // A call resets the error, as in EGL.
+    t_error = EGL_SUCCESS;
+    rule_set* set = atomic_load(&g_rules);
+    if(set == NULL || set->by_entry[entry] == NULL) {
+        return EGL_SUCCESS;
+    }
+
+    unsigned long long frame = t_frames;
+    uint64_t delay_ns = 0;
+    EGLint error = EGL_SUCCESS;
+    for(injection_rule* rule = set->by_entry[entry]; rule != NULL; rule = rule->next[entry]) {
+        // Only the first error of a call is injected.
+        if(rule->error != EGL_SUCCESS && (error != EGL_SUCCESS || !can_fail(entry))) {
+            continue;
+        }
+        unsigned long long call;
+        if(!rule_triggers(rule, frame, &call)) {
+            continue;
+        }
+        if(rule->error != EGL_SUCCESS) {
+            error = rule->error;
+            uint64_t now = egl_wrapper_now_ns();
+            // The thread gave up recovering from the previous error.
+            if(t_failed_rule != NULL && t_failed_rule != rule) {
+                record_recovery(t_failed_rule, now - t_failed_ns);
+            }
+            t_failed_rule = rule;
+            t_failed_ns = now;
+        } else {
+            uint64_t ns = sample_delay(rule, call);
+            atomic_fetch_add(&rule->delay_ns, ns);
+            delay_ns += ns;
+        }
+    }
+    if(delay_ns != 0) {
+        sleep_ns(delay_ns);
+    }
+    t_error = error;
+    return error;
+}
+
+EGLint injection_get_error(void) {
+    EGLint error = t_error;
+    injection_before_call(INJECTION_eglGetError);
+    return error;
+}
+
+void injection_after_swap(void) {
+    t_frames++;
+    atomic_fetch_add(&g_frames, 1);
+    injection_rule* rule = t_failed_rule;
+    if(rule == NULL) {
+        return;
+    }
+    t_failed_rule = NULL;
+    record_recovery(rule, egl_wrapper_now_ns() - t_failed_ns);
+}
+
+// Parses a time such as "500us" or "2.5ms". Milliseconds by default.
+static bool parse_time(const char* text, uint64_t* ns) {
+    char* end;
+    double value = strtod(text, &end);
+    if(end == text || value < 0.0) {
+        return false;
+    }
+    double scale;
+    if(*end == '\0' || strcmp(end, "ms") == 0) {
+        scale = 1e6;
+    } else if(strcmp(end, "ns") == 0) {
+        scale = 1.0;
+    } else if(strcmp(end, "us") == 0) {
+        scale = 1e3;
+    } else if(strcmp(end, "s") == 0) {
+        scale = 1e9;
+    } else {
+        return false;
+    }
+    *ns = (uint64_t)(value * scale);
+    return true;
+}
+
+static bool parse_count(const char* text, unsigned long long* value) {
+    char* end;
+    *value = strtoull(text, &end, 10);
+    return end != text && *end == '\0';
+}
+
+static bool parse_delay(char* text, injection_rule* rule) {
+    char* save = NULL;
+    char* kind = strtok_r(text, ":", &save);
+    char* a = strtok_r(NULL, ":", &save);
+    char* b = strtok_r(NULL, ":", &save);
+    if(kind == NULL) {
+        return false;
+    }
+    if(a == NULL) {
+        rule->distribution = DELAY_FIXED;
+        return parse_time(kind, &rule->delay_a_ns);
+    }
+    if(strcmp(kind, "uniform") == 0) {
+        rule->distribution = DELAY_UNIFORM;
+        return b != NULL && parse_time(a, &rule->delay_a_ns) && parse_time(b, &rule->delay_b_ns) &&
+            rule->delay_b_ns >= rule->delay_a_ns;
+    }
+    if(strcmp(kind, "normal") == 0) {
+        rule->distribution = DELAY_NORMAL;
+        return b != NULL && parse_time(a, &rule->delay_a_ns) && parse_time(b, &rule->delay_b_ns);
+    }
+    if(strcmp(kind, "exponential") == 0) {
+        rule->distribution = DELAY_EXPONENTIAL;
+        return b == NULL && parse_time(a, &rule->delay_a_ns);
+    }
+    return false;
+}
+
+static bool parse_error(const char* text, EGLint* error) {
+    for(size_t i = 0; i < sizeof(g_error_names) / sizeof(g_error_names[0]); i++) {
+        if(strcmp(text, g_error_names[i].name) == 0) {
+            *error = g_error_names[i].error;
+            return true;
+        }
+    }
+    char* end;
+    long value = strtol(text, &end, 0);
+    if(end == text || *end != '\0' || value <= EGL_SUCCESS) {
+        return false;
+    }
+    *error = (EGLint)value;
+    return true;
+}
+
+static bool parse_threads(char* text, injection_rule* rule) {
+    char* save = NULL;
+    for(char* item = strtok_r(text, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        if(rule->num_threads == MAX_RULE_THREADS) {
+            return false;
+        }
+        thread_filter* filter = &rule->threads[rule->num_threads++];
+        char* end;
+        long tid = strtol(item, &end, 10);
+        if(end != item && *end == '\0') {
+            filter->tid = (int)tid;
+        } else {
+            snprintf(filter->name, sizeof(filter->name), "%s", item);
+        }
+    }
+    return rule->num_threads != 0;
+}
+
+static bool parse_option(char* option, injection_rule* rule, bool* has_action) {
+    char* value = strchr(option, '=');
+    if(value == NULL) {
+        return false;
+    }
+    *value++ = '\0';
+    if(strcmp(option, "delay") == 0) {
+        *has_action = true;
+        return parse_delay(value, rule);
+    }
+    if(strcmp(option, "error") == 0) {
+        *has_action = true;
+        return parse_error(value, &rule->error);
+    }
+    if(strcmp(option, "threads") == 0) {
+        return parse_threads(value, rule);
+    }
+    if(strcmp(option, "after_frames") == 0) {
+        return parse_count(value, &rule->after_frames);
+    }
+    if(strcmp(option, "for_frames") == 0) {
+        return parse_count(value, &rule->for_frames);
+    }
+    if(strcmp(option, "every") == 0) {
+        return parse_count(value, &rule->every) && rule->every != 0;
+    }
+    if(strcmp(option, "count") == 0) {
+        return parse_count(value, &rule->count);
+    }
+    if(strcmp(option, "probability") == 0) {
+        char* end;
+        rule->probability = strtod(value, &end);
+        return end != value && *end == '\0' && rule->probability >= 0.0 && rule->probability <= 1.0;
+    }
+    return false;
+}
+
+// Parses "entry[,entry...] action [conditions...]" into a new rule and
+// adds it to the set. Returns false on a syntax error.
+static bool parse_rule(rule_set* set, char* line, unsigned int line_number) {
+    injection_rule* rule = calloc(1, sizeof(*rule));
+    if(rule == NULL) {
+        return false;
+    }
+    rule->line = line_number;
+    snprintf(rule->text, sizeof(rule->text), "%s", line);
+    rule->error = EGL_SUCCESS;
+    rule->every = 1;
+    rule->probability = 1.0;
+
+    char* save = NULL;
+    char* entries = strtok_r(line, " \t", &save);
+    bool has_action = false;
+    bool valid = true;
+    for(char* option = strtok_r(NULL, " \t", &save); option != NULL && valid; option = strtok_r(NULL, " \t", &save)) {
+        valid = parse_option(option, rule, &has_action);
+    }
+    if(!valid || !has_action) {
+        free(rule);
+        return false;
+    }
+
+    bool matched[INJECTION_NUM_ENTRIES] = { false };
+    char* entry_save = NULL;
+    for(char* name = strtok_r(entries, ",", &entry_save); name != NULL; name = strtok_r(NULL, ",", &entry_save)) {
+        bool found = false;
+        for(unsigned int i = 0; i < INJECTION_NUM_ENTRIES; i++) {
+            // Errors with "*" only go to the functions which can fail.
+            if(strcmp(name, g_entry_names[i]) == 0 ||
+                (strcmp(name, "*") == 0 && (rule->error == EGL_SUCCESS || can_fail((injection_entry)i)))) {
+                matched[i] = true;
+                found = true;
+            }
+        }
+        if(!found) {
+            free(rule);
+            return false;
+        }
+    }
+    for(unsigned int i = 0; i < INJECTION_NUM_ENTRIES; i++) {
+        if(matched[i] && rule->error != EGL_SUCCESS && !can_fail((injection_entry)i)) {
+            fprintf(stderr, "%s can't fail, ignoring the error of line %u\n", g_entry_names[i], line_number);
+            matched[i] = false;
+        }
+    }
+
+    // Keep the rules in file order, per entry point and overall.
+    for(unsigned int i = 0; i < INJECTION_NUM_ENTRIES; i++) {
+        if(!matched[i]) {
+            continue;
+        }
+        injection_rule** tail = &set->by_entry[i];
+        while(*tail != NULL) {
+            tail = &(*tail)->next[i];
+        }
+        *tail = rule;
+    }
+    injection_rule** tail = &set->rules;
+    while(*tail != NULL) {
+        tail = &(*tail)->next_rule;
+    }
+    *tail = rule;
+    return true;
+}
+
+bool egl_wrapper_load_injection_rules(const char* path) {
+    if(path == NULL) {
+        atomic_store(&g_rules, NULL);
+        g_injection_enabled = false;
+        return true;
+    }
+    FILE* file = fopen(path, "r");
+    if(file == NULL) {
+        fprintf(stderr, "Failed to open injection rules %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    rule_set* set = calloc(1, sizeof(*set));
+    if(set == NULL) {
+        fclose(file);
+        return false;
+    }
+    snprintf(set->path, sizeof(set->path), "%s", path);
+
+    char line[1024];
+    unsigned int line_number = 0;
+    bool valid = true;
+    while(fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        char* rule = line + strspn(line, " \t");
+        size_t length = strlen(rule);
+        while(length > 0 && (rule[length - 1] == ' ' || rule[length - 1] == '\t')) {
+            rule[--length] = '\0';
+        }
+        if(*rule != '\0' && !parse_rule(set, rule, line_number)) {
+            fprintf(stderr, "Invalid injection rule at %s:%u: %s\n", path, line_number, rule);
+            valid = false;
+        }
+    }
+    fclose(file);
+    // Rather no injection than a partial one.
+    if(!valid) {
+        for(injection_rule* rule = set->rules; rule != NULL;) {
+            injection_rule* next = rule->next_rule;
+            free(rule);
+            rule = next;
+        }
+        free(set);
+        return false;
+    }
+
+    atomic_store(&g_rules, set);
+    g_injection_enabled = true;
+    return true;
+}
+
+void egl_wrapper_print_injection_report(void) {
+    rule_set* set = atomic_load(&g_rules);
+    if(set == NULL) {
+        return;
+    }
+    fprintf(stderr, "Injection report (%s, %llu frames):\n", set->path, (unsigned long long)atomic_load(&g_frames));
+    for(injection_rule* rule = set->rules; rule != NULL; rule = rule->next_rule) {
+        fprintf(stderr, "  line %u: %s\n", rule->line, rule->text);
+        fprintf(stderr, "    %llu of %llu calls injected", (unsigned long long)rule->injected,
+            (unsigned long long)rule->calls);
+        if(rule->error == EGL_SUCCESS) {
+            fprintf(stderr, ", %.3f ms of delay\n", rule->delay_ns / 1e6);
+            continue;
+        }
+        fprintf(stderr, "\n");
+        if(rule->recoveries != 0) {
+            fprintf(stderr, "    recovered %llu time(s): %.3f ms on average, %.3f ms at most\n",
+                (unsigned long long)rule->recoveries, rule->recovery_ns / 1e6 / rule->recoveries,
+                rule->max_recovery_ns / 1e6);
+        }
+    }
+}
+
+void injection_init_from_env(void) {
+    const char* seed = getenv("EGL_WRAPPER_INJECT_SEED");
+    if(seed != NULL) {
+        g_seed = strtoull(seed, NULL, 0);
+    }
+    const char* path = getenv("EGL_WRAPPER_INJECT_RULES");
+    if(path == NULL) {
+        return;
+    }
+    if(!egl_wrapper_load_injection_rules(path)) {
+        fprintf(stderr, "Injection rules not loaded\n");
+        return;
+    }
+    atexit(egl_wrapper_print_injection_report);
+    printf("Injection rules loaded from %s\n", path);
+}
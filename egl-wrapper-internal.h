@@ -0,0 +1,232 @@
+#ifndef EGL_WRAPPER_INTERNAL_H
+#define EGL_WRAPPER_INTERNAL_H
+
+// Declarations shared between the translation units of egl-wrapper.
+// Nothing in here is part of the public API.
+
+#include "egl-wrapper.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdatomic.h>
+
+// Monotonic time in nanoseconds.
+static inline uint64_t egl_wrapper_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Underlying EGL libraries (egl-wrapper.c)
+
+#define MAX_EGL_LIBRARIES 8
+#define MAX_EGL_DISPLAYS 64
+
+// The functions of one loaded EGL library.
+typedef struct {
+    void* handle;
+    unsigned int index;
+    _Atomic unsigned int num_contexts;
+    EGLint (*eglGetError)(void);
+    EGLDisplay (*eglGetDisplay)(EGLNativeDisplayType);
+    EGLBoolean (*eglInitialize)(EGLDisplay, EGLint *, EGLint *);
+    EGLBoolean (*eglTerminate)(EGLDisplay);
+    const char * (*eglQueryString)(EGLDisplay, EGLint);
+    EGLBoolean (*eglGetConfigs)(EGLDisplay, EGLConfig *, EGLint, EGLint *);
+    EGLBoolean (*eglChooseConfig)(EGLDisplay, const EGLint *, EGLConfig *, EGLint, EGLint *);
+    EGLBoolean (*eglGetConfigAttrib)(EGLDisplay, EGLConfig, EGLint, EGLint *);
+    EGLSurface (*eglCreateWindowSurface)(EGLDisplay, EGLConfig, EGLNativeWindowType, const EGLint *);
+    EGLSurface (*eglCreatePbufferSurface)(EGLDisplay, EGLConfig, const EGLint *);
+    EGLSurface (*eglCreatePixmapSurface)(EGLDisplay, EGLConfig, EGLNativePixmapType, const EGLint *);
+    EGLBoolean (*eglDestroySurface)(EGLDisplay, EGLSurface);
+    EGLBoolean (*eglQuerySurface)(EGLDisplay, EGLSurface, EGLint, EGLint *);
+    EGLBoolean (*eglBindAPI)(EGLenum);
+    EGLenum (*eglQueryAPI)(void);
+    EGLBoolean (*eglWaitClient)(void);
+    EGLBoolean (*eglReleaseThread)(void);
+    EGLSurface (*eglCreatePbufferFromClientBuffer)(EGLDisplay, EGLenum, EGLClientBuffer, EGLConfig, const EGLint *);
+    EGLBoolean (*eglSurfaceAttrib)(EGLDisplay, EGLSurface, EGLint, EGLint);
+    EGLBoolean (*eglBindTexImage)(EGLDisplay, EGLSurface, EGLint);
+    EGLBoolean (*eglReleaseTexImage)(EGLDisplay, EGLSurface, EGLint);
+    EGLBoolean (*eglSwapInterval)(EGLDisplay, EGLint);
+    EGLContext (*eglCreateContext)(EGLDisplay, EGLConfig, EGLContext, const EGLint *);
+    EGLBoolean (*eglDestroyContext)(EGLDisplay, EGLContext);
+    EGLBoolean (*eglMakeCurrent)(EGLDisplay, EGLSurface, EGLSurface, EGLContext);
+    EGLContext (*eglGetCurrentContext)(void);
+    EGLSurface (*eglGetCurrentSurface)(EGLint);
+    EGLDisplay (*eglGetCurrentDisplay)(void);
+    EGLBoolean (*eglQueryContext)(EGLDisplay, EGLContext, EGLint, EGLint *);
+    EGLBoolean (*eglWaitGL)(void);
+    EGLBoolean (*eglWaitNative)(EGLint);
+    EGLBoolean (*eglSwapBuffers)(EGLDisplay, EGLSurface);
+    EGLBoolean (*eglCopyBuffers)(EGLDisplay, EGLSurface, EGLNativePixmapType);
+    __eglMustCastToProperFunctionPointerType (*eglGetProcAddress)(const char*);
+} egl_dispatch_table;
+
+extern egl_dispatch_table g_libraries[MAX_EGL_LIBRARIES];
+extern unsigned int g_num_libraries;
+extern __thread egl_dispatch_table* t_current_library;
+
+// Looks up a function of a wrapped library by name.
+typedef void* (*egl_wrapper_symbol_lookup)(void* ctx, const char* name);
+
+// Makes egl_wrapper_initialize wrap a single, already loaded library
+// whose functions are found through lookup(ctx, name), instead of
+// loading libraries by path. Must be called before initialization.
+void set_wrapped_library_lookup(const char* name, egl_wrapper_symbol_lookup lookup, void* ctx);
+
+// Look up the library owning a display. Unknown displays belong to
+// the default library.
+egl_dispatch_table* route_display(EGLDisplay dpy);
+
+static inline egl_dispatch_table* dispatch_for_display(EGLDisplay dpy) {
+    if(g_num_libraries == 1) {
+        return &g_libraries[0];
+    }
+    return route_display(dpy);
+}
+
+// The library of the context current on this thread, or the default one.
+static inline egl_dispatch_table* dispatch_for_thread(void) {
+    return t_current_library != NULL ? t_current_library : &g_libraries[0];
+}
+
+// Frame decimation (egl-wrapper-decimation.c)
+
+// Set when a decimation policy is active, so that the swap path can
+// skip the policy entirely with a single load otherwise.
+extern _Atomic bool g_decimation_enabled;
+
+// Reads EGL_WRAPPER_PRESENT_EVERY_NTH / EGL_WRAPPER_MAX_PRESENT_HZ.
+void decimation_init_from_env(void);
+
+// Returns true if this swap of the given surface should be forwarded.
+// Otherwise, the frame is counted as skipped and the caller should
+// return decimation_skip_swap() instead of swapping.
+bool decimation_should_present(EGLSurface surface);
+EGLBoolean decimation_skip_swap(void);
+
+// Forgets any per-surface state kept for the given surface.
+void decimation_forget_surface(EGLSurface surface);
+
+// GPU fences inserted at eglSwapBuffers (egl-wrapper-fences.c)
+
+// Set when any feature needs a fence before each forwarded swap.
+extern _Atomic bool g_fences_enabled;
+
+// Reads EGL_WRAPPER_GPU_TIMING / EGL_WRAPPER_MAX_FRAMES_IN_FLIGHT.
+void fences_init_from_env(void);
+
+// Inserts a fence for the frame about to be swapped on surface.
+// Never blocks on the GPU.
+void fences_before_swap(EGLDisplay dpy, EGLSurface surface);
+
+// Called after a successful forwarded swap. Blocks until the number of
+// frames in flight on surface is within the configured limit.
+void fences_after_swap(EGLSurface surface);
+
+// Destroys the fences still pending for a surface being destroyed and
+// frees its queue. Safe to call while fences are disabled.
+void fences_forget_surface(EGLSurface surface);
+
+// Render thread policy (egl-wrapper-render-threads.c)
+
+extern _Atomic bool g_render_threads_enabled;
+
+// Reads EGL_WRAPPER_RENDER_CPUS / EGL_WRAPPER_RENDER_NICE / EGL_WRAPPER_RENDER_SCHED.
+void render_threads_init_from_env(void);
+
+// Called after a successful eglMakeCurrent binding a context. Applies the
+// policy the first time for each thread.
+void render_threads_after_make_current(void);
+
+// Called after each forwarded swap to track core migrations.
+void render_threads_after_swap(void);
+
+// Redundant-call analysis (egl-wrapper-redundancy.c)
+
+extern _Atomic bool g_redundancy_enabled;
+
+// Reads EGL_WRAPPER_REDUNDANCY_REPORT.
+void redundancy_init_from_env(void);
+
+// Called after each analyzed call, with the return address of the
+// exported function and the time the call started (0 if unknown).
+void redundancy_make_current(void* call_site, uint64_t start_ns, EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx, EGLBoolean result);
+void redundancy_query_surface(void* call_site, uint64_t start_ns, EGLDisplay dpy, EGLSurface surface, EGLint attribute, const EGLint* value, EGLBoolean result);
+void redundancy_get_config_attrib(void* call_site, uint64_t start_ns, EGLDisplay dpy, EGLConfig config, EGLint attribute, const EGLint* value, EGLBoolean result);
+void redundancy_get_proc_address(void* call_site, uint64_t start_ns, const char* proc_name);
+void redundancy_get_error(void* call_site, uint64_t start_ns, EGLint result);
+void redundancy_swap_interval(void* call_site, uint64_t start_ns, EGLDisplay dpy, EGLint interval, EGLBoolean result);
+
+// Called at the start of every other entry point (and routed extension
+// function): only back-to-back eglGetError polls are redundant.
+void redundancy_other_call(void);
+
+// Called at the start of each eglSwapBuffers, which ends the frame of
+// the calling thread.
+void redundancy_end_frame(void);
+
+// Scoped hooks (egl-wrapper-scopes.c)
+
+// Hooks scoped to the calling thread's binding. NULL if none apply, so
+// that unscoped calls only pay for this load, the one of
+// g_scoped_hooks_used and, once that is set, t_scoped_hooks_registered.
+// Set to a marker by other threads when the scoped hooks change, so that
+// the next call takes the slow path of scoped_hooks_for_thread.
+extern __thread const egl_wrapper_plugin_hooks* _Atomic t_scoped_hooks;
+
+// Whether the calling thread is registered to be marked stale.
+extern __thread bool t_scoped_hooks_registered;
+
+// Set once any scoped hooks were registered.
+extern _Atomic bool g_scoped_hooks_used;
+
+// Slow path: brings t_scoped_hooks up to date and returns it. Unless
+// query_binding, a binding made before any scoped hooks existed isn't
+// asked from the driver: only the thread scope applies then, and the
+// thread is left for its next call to register.
+const egl_wrapper_plugin_hooks* scoped_hooks_for_thread(bool query_binding);
+
+// Called after a successful eglMakeCurrent or eglReleaseThread.
+void scoped_hooks_after_make_current(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx);
+
+// Hook plugins (egl-wrapper-plugins.c)
+
+// Hooks installed by the plugins, kept apart from those registered by the
+// application so that loading or unloading plugins doesn't change them.
+// Takes precedence over the registered hook of a call if set.
+extern egl_wrapper_plugin_hooks g_plugin_callbacks;
+
+// Reads EGL_WRAPPER_PLUGINS / EGL_WRAPPER_PLUGIN_CONFIG.
+void plugins_init_from_env(void);
+
+// Latency and failure injection (egl-wrapper-injection.c)
+
+#define INJECTION_ENTRY(F) INJECTION_egl##F,
+typedef enum {
+    EGL_WRAPPER_ENTRIES(INJECTION_ENTRY)
+    INJECTION_NUM_ENTRIES
+} injection_entry;
+#undef INJECTION_ENTRY
+
+// Set while injection rules are loaded.
+extern _Atomic bool g_injection_enabled;
+
+// Reads EGL_WRAPPER_INJECT_RULES / EGL_WRAPPER_INJECT_SEED.
+void injection_init_from_env(void);
+
+// Applies the rules to a call, sleeping for any injected delay. Returns
+// the injected error, or EGL_SUCCESS if the call should go on.
+EGLint injection_before_call(injection_entry entry);
+
+// For eglGetError: returns the error injected in the thread's last call,
+// or EGL_SUCCESS if the wrapped library's error should be returned.
+EGLint injection_get_error(void);
+
+// Called after a successful eglSwapBuffers, which ends the thread's
+// frame.
+void injection_after_swap(void);
+
+#endif
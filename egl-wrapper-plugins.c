@@ -0,0 +1,744 @@
+// This file implements hook plugins: shared libraries listed in the
+// environment or a config file, whose hooks can be reloaded at runtime.
+//
+// The hooks of all loaded plugins are merged into one plugin_set, which is
+// published through an atomic pointer. Hooked calls go through a trampoline
+// which reads the active set within an epoch. On reload, a new set is
+// published and the old one is only unloaded once all calls which may
+// still use it have drained.
+
+#define _GNU_SOURCE
+
+#include "egl-wrapper-internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/inotify.h>
+
+#define MAX_PLUGINS 16
+
+// Types
+typedef struct {
+    void* handle;
+    void (*shutdown)(void);
+    char* path;
+} loaded_plugin;
+
+typedef struct {
+    // Merged hooks: for each call, the hook of the first plugin in the
+    // list which hooks it.
+    egl_wrapper_plugin_hooks hooks;
+    loaded_plugin plugins[MAX_PLUGINS];
+    unsigned int num_plugins;
+} plugin_set;
+
+// Globals
+static plugin_set g_empty_set;
+static plugin_set* _Atomic g_active = &g_empty_set;
+
+// Readers of g_active count themselves in g_readers[epoch parity].
+static _Atomic unsigned int g_epoch = 0;
+static _Atomic unsigned long g_readers[2];
+
+static pthread_mutex_t g_reload_lock = PTHREAD_MUTEX_INITIALIZER;
+static char* g_plugin_list = NULL;     // ':'-separated paths, or NULL
+static char* g_config_path = NULL;     // file listing paths, or NULL
+static unsigned long long g_generation = 0;
+
+// Bytes written to g_wake_pipe for the watch thread.
+#define WAKE_RELOAD 1
+#define WAKE_REWATCH 2
+
+static int g_wake_pipe[2] = { -1, -1 };
+static bool g_watch_thread_running = false;
+
+static inline unsigned int plugins_enter(void) {
+    unsigned int epoch = atomic_load(&g_epoch) & 1;
+    atomic_fetch_add(&g_readers[epoch], 1);
+    return epoch;
+}
+
+static inline void plugins_leave(unsigned int epoch) {
+    atomic_fetch_sub(&g_readers[epoch], 1);
+}
+
+// Wait until no call can still use a set which was replaced before this
+// is called. New readers are moved to the other counter by flipping the
+// epoch, so each counter drains in turn.
+static void wait_for_readers(void) {
+    for(int i = 0; i < 2; i++) {
+        unsigned int old = atomic_fetch_add(&g_epoch, 1) & 1;
+        while(atomic_load(&g_readers[old]) != 0) {
+            sched_yield();
+        }
+    }
+}
+
+// Trampolines registered as hooks for the calls which plugins hook.
+
+static EGLint plugin_eglGetError(void) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLint result = hooks->eglGetError != NULL ?
+        hooks->eglGetError() : bare_eglGetError();
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLDisplay plugin_eglGetDisplay(EGLNativeDisplayType display_id) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLDisplay result = hooks->eglGetDisplay != NULL ?
+        hooks->eglGetDisplay(display_id) : bare_eglGetDisplay(display_id);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglInitialize(EGLDisplay dpy, EGLint *major, EGLint *minor) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglInitialize != NULL ?
+        hooks->eglInitialize(dpy, major, minor) : bare_eglInitialize(dpy, major, minor);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglTerminate(EGLDisplay dpy) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglTerminate != NULL ?
+        hooks->eglTerminate(dpy) : bare_eglTerminate(dpy);
+    plugins_leave(epoch);
+    return result;
+}
+
+static const char * plugin_eglQueryString(EGLDisplay dpy, EGLint name) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    const char * result = hooks->eglQueryString != NULL ?
+        hooks->eglQueryString(dpy, name) : bare_eglQueryString(dpy, name);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglGetConfigs(EGLDisplay dpy, EGLConfig *configs, EGLint config_size, EGLint *num_config) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglGetConfigs != NULL ?
+        hooks->eglGetConfigs(dpy, configs, config_size, num_config) : bare_eglGetConfigs(dpy, configs, config_size, num_config);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglChooseConfig(EGLDisplay dpy, const EGLint *attrib_list, EGLConfig *configs, EGLint config_size, EGLint *num_config) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglChooseConfig != NULL ?
+        hooks->eglChooseConfig(dpy, attrib_list, configs, config_size, num_config) : bare_eglChooseConfig(dpy, attrib_list, configs, config_size, num_config);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglGetConfigAttrib(EGLDisplay dpy, EGLConfig config, EGLint attribute, EGLint *value) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglGetConfigAttrib != NULL ?
+        hooks->eglGetConfigAttrib(dpy, config, attribute, value) : bare_eglGetConfigAttrib(dpy, config, attribute, value);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLSurface plugin_eglCreateWindowSurface(EGLDisplay dpy, EGLConfig config, EGLNativeWindowType win, const EGLint *attrib_list) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLSurface result = hooks->eglCreateWindowSurface != NULL ?
+        hooks->eglCreateWindowSurface(dpy, config, win, attrib_list) : bare_eglCreateWindowSurface(dpy, config, win, attrib_list);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLSurface plugin_eglCreatePbufferSurface(EGLDisplay dpy, EGLConfig config, const EGLint *attrib_list) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLSurface result = hooks->eglCreatePbufferSurface != NULL ?
+        hooks->eglCreatePbufferSurface(dpy, config, attrib_list) : bare_eglCreatePbufferSurface(dpy, config, attrib_list);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLSurface plugin_eglCreatePixmapSurface(EGLDisplay dpy, EGLConfig config, EGLNativePixmapType pixmap, const EGLint *attrib_list) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLSurface result = hooks->eglCreatePixmapSurface != NULL ?
+        hooks->eglCreatePixmapSurface(dpy, config, pixmap, attrib_list) : bare_eglCreatePixmapSurface(dpy, config, pixmap, attrib_list);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglDestroySurface(EGLDisplay dpy, EGLSurface surface) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglDestroySurface != NULL ?
+        hooks->eglDestroySurface(dpy, surface) : bare_eglDestroySurface(dpy, surface);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglQuerySurface(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint *value) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglQuerySurface != NULL ?
+        hooks->eglQuerySurface(dpy, surface, attribute, value) : bare_eglQuerySurface(dpy, surface, attribute, value);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglBindAPI(EGLenum api) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglBindAPI != NULL ?
+        hooks->eglBindAPI(api) : bare_eglBindAPI(api);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLenum plugin_eglQueryAPI(void) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLenum result = hooks->eglQueryAPI != NULL ?
+        hooks->eglQueryAPI() : bare_eglQueryAPI();
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglWaitClient(void) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglWaitClient != NULL ?
+        hooks->eglWaitClient() : bare_eglWaitClient();
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglReleaseThread(void) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglReleaseThread != NULL ?
+        hooks->eglReleaseThread() : bare_eglReleaseThread();
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLSurface plugin_eglCreatePbufferFromClientBuffer(EGLDisplay dpy, EGLenum buftype, EGLClientBuffer buffer, EGLConfig config, const EGLint *attrib_list) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLSurface result = hooks->eglCreatePbufferFromClientBuffer != NULL ?
+        hooks->eglCreatePbufferFromClientBuffer(dpy, buftype, buffer, config, attrib_list) : bare_eglCreatePbufferFromClientBuffer(dpy, buftype, buffer, config, attrib_list);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglSurfaceAttrib(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint value) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglSurfaceAttrib != NULL ?
+        hooks->eglSurfaceAttrib(dpy, surface, attribute, value) : bare_eglSurfaceAttrib(dpy, surface, attribute, value);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglBindTexImage(EGLDisplay dpy, EGLSurface surface, EGLint buffer) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglBindTexImage != NULL ?
+        hooks->eglBindTexImage(dpy, surface, buffer) : bare_eglBindTexImage(dpy, surface, buffer);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglReleaseTexImage(EGLDisplay dpy, EGLSurface surface, EGLint buffer) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglReleaseTexImage != NULL ?
+        hooks->eglReleaseTexImage(dpy, surface, buffer) : bare_eglReleaseTexImage(dpy, surface, buffer);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglSwapInterval(EGLDisplay dpy, EGLint interval) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglSwapInterval != NULL ?
+        hooks->eglSwapInterval(dpy, interval) : bare_eglSwapInterval(dpy, interval);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLContext plugin_eglCreateContext(EGLDisplay dpy, EGLConfig config, EGLContext share_context, const EGLint *attrib_list) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLContext result = hooks->eglCreateContext != NULL ?
+        hooks->eglCreateContext(dpy, config, share_context, attrib_list) : bare_eglCreateContext(dpy, config, share_context, attrib_list);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglDestroyContext(EGLDisplay dpy, EGLContext ctx) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglDestroyContext != NULL ?
+        hooks->eglDestroyContext(dpy, ctx) : bare_eglDestroyContext(dpy, ctx);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglMakeCurrent != NULL ?
+        hooks->eglMakeCurrent(dpy, draw, read, ctx) : bare_eglMakeCurrent(dpy, draw, read, ctx);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLContext plugin_eglGetCurrentContext(void) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLContext result = hooks->eglGetCurrentContext != NULL ?
+        hooks->eglGetCurrentContext() : bare_eglGetCurrentContext();
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLSurface plugin_eglGetCurrentSurface(EGLint readdraw) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLSurface result = hooks->eglGetCurrentSurface != NULL ?
+        hooks->eglGetCurrentSurface(readdraw) : bare_eglGetCurrentSurface(readdraw);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLDisplay plugin_eglGetCurrentDisplay(void) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLDisplay result = hooks->eglGetCurrentDisplay != NULL ?
+        hooks->eglGetCurrentDisplay() : bare_eglGetCurrentDisplay();
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglQueryContext(EGLDisplay dpy, EGLContext ctx, EGLint attribute, EGLint *value) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglQueryContext != NULL ?
+        hooks->eglQueryContext(dpy, ctx, attribute, value) : bare_eglQueryContext(dpy, ctx, attribute, value);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglWaitGL(void) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglWaitGL != NULL ?
+        hooks->eglWaitGL() : bare_eglWaitGL();
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglWaitNative(EGLint engine) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglWaitNative != NULL ?
+        hooks->eglWaitNative(engine) : bare_eglWaitNative(engine);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglSwapBuffers(EGLDisplay dpy, EGLSurface surface) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglSwapBuffers != NULL ?
+        hooks->eglSwapBuffers(dpy, surface) : bare_eglSwapBuffers(dpy, surface);
+    plugins_leave(epoch);
+    return result;
+}
+
+static EGLBoolean plugin_eglCopyBuffers(EGLDisplay dpy, EGLSurface surface, EGLNativePixmapType target) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    EGLBoolean result = hooks->eglCopyBuffers != NULL ?
+        hooks->eglCopyBuffers(dpy, surface, target) : bare_eglCopyBuffers(dpy, surface, target);
+    plugins_leave(epoch);
+    return result;
+}
+
+static __eglMustCastToProperFunctionPointerType plugin_eglGetProcAddress(const char* proc_name) {
+    unsigned int epoch = plugins_enter();
+    const egl_wrapper_plugin_hooks* hooks = &atomic_load(&g_active)->hooks;
+    __eglMustCastToProperFunctionPointerType result = hooks->eglGetProcAddress != NULL ?
+        hooks->eglGetProcAddress(proc_name) : bare_eglGetProcAddress(proc_name);
+    plugins_leave(epoch);
+    return result;
+}
+
+// dlopen a private copy of a plugin. Opening the same path again would
+// return the already loaded library instead of the changed file.
+static void* open_plugin_copy(const char* path) {
+    const char* tmpdir = getenv("TMPDIR");
+    char copy_path[4096];
+    snprintf(copy_path, sizeof(copy_path), "%s/egl-wrapper-plugin-XXXXXX",
+        tmpdir != NULL ? tmpdir : "/tmp");
+
+    int in = open(path, O_RDONLY | O_CLOEXEC);
+    if(in < 0) {
+        fprintf(stderr, "Failed to open plugin %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    int out = mkstemp(copy_path);
+    if(out < 0) {
+        fprintf(stderr, "Failed to copy plugin %s: %s\n", path, strerror(errno));
+        close(in);
+        return NULL;
+    }
+
+    char buffer[65536];
+    ssize_t n;
+    bool ok = true;
+    while((n = read(in, buffer, sizeof(buffer))) > 0) {
+        if(write(out, buffer, (size_t)n) != n) {
+            ok = false;
+            break;
+        }
+    }
+    ok = ok && n == 0;
+    close(in);
+    close(out);
+
+    void* handle = NULL;
+    if(ok) {
+        handle = dlopen(copy_path, RTLD_NOW | RTLD_LOCAL);
+        if(handle == NULL) {
+            fprintf(stderr, "Failed to load plugin %s: %s\n", path, dlerror());
+        }
+    } else {
+        fprintf(stderr, "Failed to copy plugin %s\n", path);
+    }
+    unlink(copy_path);
+    return handle;
+}
+
+static void load_plugin(plugin_set* set, const char* path) {
+    if(set->num_plugins == MAX_PLUGINS) {
+        fprintf(stderr, "Too many plugins, ignoring %s\n", path);
+        return;
+    }
+    void* handle = open_plugin_copy(path);
+    if(handle == NULL) {
+        return;
+    }
+    void (*init)(egl_wrapper_plugin_hooks*) =
+        (void (*)(egl_wrapper_plugin_hooks*))dlsym(handle, "egl_wrapper_plugin_init");
+    if(init == NULL) {
+        fprintf(stderr, "Plugin %s has no egl_wrapper_plugin_init\n", path);
+        dlclose(handle);
+        return;
+    }
+
+    egl_wrapper_plugin_hooks hooks;
+    memset(&hooks, 0, sizeof(hooks));
+    init(&hooks);
+
+    egl_wrapper_plugin_hooks* merged = &set->hooks;
+#define MERGE_HOOK(F) \
+    if(merged->egl##F == NULL) { \
+        merged->egl##F = hooks.egl##F; \
+    }
+    EGL_WRAPPER_ENTRIES(MERGE_HOOK)
+#undef MERGE_HOOK
+
+    loaded_plugin* plugin = &set->plugins[set->num_plugins++];
+    plugin->handle = handle;
+    plugin->shutdown = (void (*)(void))dlsym(handle, "egl_wrapper_plugin_shutdown");
+    plugin->path = strdup(path);
+    printf("Loaded plugin %s\n", path);
+}
+
+static void load_plugin_list(plugin_set* set, const char* list) {
+    char* paths = strdup(list);
+    char* save = NULL;
+    for(char* path = strtok_r(paths, ":", &save); path != NULL; path = strtok_r(NULL, ":", &save)) {
+        load_plugin(set, path);
+    }
+    free(paths);
+}
+
+// The config file lists one plugin path per line. Empty lines and
+// lines starting with '#' are ignored.
+static void load_plugin_config(plugin_set* set, const char* config_path) {
+    FILE* config = fopen(config_path, "r");
+    if(config == NULL) {
+        fprintf(stderr, "Failed to open plugin config %s: %s\n", config_path, strerror(errno));
+        return;
+    }
+    char line[4096];
+    while(fgets(line, sizeof(line), config) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char* path = line + strspn(line, " \t");
+        if(*path != '\0' && *path != '#') {
+            load_plugin(set, path);
+        }
+    }
+    fclose(config);
+}
+
+static void unload_plugin_set(plugin_set* set) {
+    if(set == &g_empty_set) {
+        return;
+    }
+    for(unsigned int i = 0; i < set->num_plugins; i++) {
+        if(set->plugins[i].shutdown != NULL) {
+            set->plugins[i].shutdown();
+        }
+        dlclose(set->plugins[i].handle);
+        free(set->plugins[i].path);
+    }
+    free(set);
+}
+
+// Remove the trampolines of calls which the new set doesn't hook. Done
+// before the new set is published, so that these calls go back to the
+// application's hooks rather than through a set without them.
+static void remove_unhooked(const egl_wrapper_plugin_hooks* hooks) {
+#define REMOVE_HOOK(F) \
+    if(hooks->egl##F == NULL) { \
+        g_plugin_callbacks.egl##F = NULL; \
+    }
+    EGL_WRAPPER_ENTRIES(REMOVE_HOOK)
+#undef REMOVE_HOOK
+}
+
+// Install the trampolines of calls which the new set hooks. Done once it
+// is published.
+static void install_hooked(const egl_wrapper_plugin_hooks* hooks) {
+#define INSTALL_HOOK(F) \
+    if(hooks->egl##F != NULL) { \
+        g_plugin_callbacks.egl##F = plugin_egl##F; \
+    }
+    EGL_WRAPPER_ENTRIES(INSTALL_HOOK)
+#undef INSTALL_HOOK
+}
+
+static void wake_watch_thread(char reason) {
+    if(g_watch_thread_running) {
+        ssize_t ignored = write(g_wake_pipe[1], &reason, 1);
+        (void)ignored;
+    }
+}
+
+void egl_wrapper_reload_plugins(void) {
+    pthread_mutex_lock(&g_reload_lock);
+
+    plugin_set* set = calloc(1, sizeof(*set));
+    if(set == NULL) {
+        pthread_mutex_unlock(&g_reload_lock);
+        return;
+    }
+    if(g_plugin_list != NULL) {
+        load_plugin_list(set, g_plugin_list);
+    }
+    if(g_config_path != NULL) {
+        load_plugin_config(set, g_config_path);
+    }
+
+    remove_unhooked(&set->hooks);
+    plugin_set* old_set = atomic_exchange(&g_active, set);
+    install_hooked(&set->hooks);
+    wait_for_readers();
+    unload_plugin_set(old_set);
+
+    g_generation++;
+    printf("Plugins loaded (generation %llu): %u plugin(s)\n", g_generation, set->num_plugins);
+    // The plugins listed in the config file may have changed.
+    wake_watch_thread(WAKE_REWATCH);
+    pthread_mutex_unlock(&g_reload_lock);
+}
+
+static void reload_signal_handler(int sig) {
+    (void)sig;
+    char c = WAKE_RELOAD;
+    ssize_t ignored = write(g_wake_pipe[1], &c, 1);
+    (void)ignored;
+}
+
+// Add an inotify watch on the directory containing path, and remember
+// the file name to react to.
+static void watch_file(int inotify_fd, const char* path, char names[][256], unsigned int* num_names) {
+    char* dir_copy = strdup(path);
+    char* name_copy = strdup(path);
+    if(inotify_add_watch(inotify_fd, dirname(dir_copy), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        fprintf(stderr, "Failed to watch %s: %s\n", path, strerror(errno));
+    } else if(*num_names < 2 * MAX_PLUGINS + 1) {
+        snprintf(names[(*num_names)++], 256, "%s", basename(name_copy));
+    }
+    free(dir_copy);
+    free(name_copy);
+}
+
+// Watch the config file and the plugins currently loaded, dropping the
+// watches of the files watched before. Returns the new inotify fd.
+static int rewatch(int inotify_fd, char names[][256], unsigned int* num_names) {
+    if(inotify_fd >= 0) {
+        close(inotify_fd);
+    }
+    *num_names = 0;
+    inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if(inotify_fd < 0) {
+        fprintf(stderr, "Failed to watch plugins for changes: %s\n", strerror(errno));
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_reload_lock);
+    if(g_config_path != NULL) {
+        watch_file(inotify_fd, g_config_path, names, num_names);
+    }
+    // Plugins which failed to load are watched too, so that fixing them
+    // reloads.
+    if(g_plugin_list != NULL) {
+        char* paths = strdup(g_plugin_list);
+        char* save = NULL;
+        for(char* path = strtok_r(paths, ":", &save); path != NULL; path = strtok_r(NULL, ":", &save)) {
+            watch_file(inotify_fd, path, names, num_names);
+        }
+        free(paths);
+    }
+    const plugin_set* set = atomic_load(&g_active);
+    for(unsigned int i = 0; i < set->num_plugins; i++) {
+        watch_file(inotify_fd, set->plugins[i].path, names, num_names);
+    }
+    pthread_mutex_unlock(&g_reload_lock);
+    return inotify_fd;
+}
+
+static void* watch_thread_main(void* arg) {
+    (void)arg;
+    char names[2 * MAX_PLUGINS + 1][256];
+    unsigned int num_names = 0;
+    int inotify_fd = rewatch(-1, names, &num_names);
+
+    for(;;) {
+        struct pollfd fds[2] = {
+            { .fd = g_wake_pipe[0], .events = POLLIN },
+            { .fd = inotify_fd, .events = POLLIN }
+        };
+        if(poll(fds, inotify_fd >= 0 ? 2 : 1, -1) < 0) {
+            continue;
+        }
+        bool reload = false;
+        bool rewatch_needed = false;
+        if(fds[0].revents & POLLIN) {
+            char c;
+            while(read(g_wake_pipe[0], &c, 1) == 1) {
+                reload = reload || c == WAKE_RELOAD;
+                rewatch_needed = rewatch_needed || c == WAKE_REWATCH;
+            }
+        }
+        if(inotify_fd >= 0 && (fds[1].revents & POLLIN)) {
+            char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t len = read(inotify_fd, buffer, sizeof(buffer));
+            bool changed = false;
+            for(char* p = buffer; len > 0 && p < buffer + len;) {
+                struct inotify_event* event = (struct inotify_event*)p;
+                for(unsigned int i = 0; event->len > 0 && i < num_names; i++) {
+                    if(strcmp(event->name, names[i]) == 0) {
+                        changed = true;
+                    }
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+            if(changed) {
+                // A file is often written in several steps, wait for the
+                // burst of events to end.
+                usleep(100000);
+                while(read(inotify_fd, buffer, sizeof(buffer)) > 0) {}
+                reload = true;
+            }
+        }
+        if(reload) {
+            // Rewatches through WAKE_REWATCH.
+            egl_wrapper_reload_plugins();
+        } else if(rewatch_needed) {
+            inotify_fd = rewatch(inotify_fd, names, &num_names);
+        }
+    }
+    return NULL;
+}
+
+static void start_watching(void) {
+    if(g_watch_thread_running) {
+        return;
+    }
+    if(pipe2(g_wake_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        fprintf(stderr, "Failed to create plugin reload pipe: %s\n", strerror(errno));
+        return;
+    }
+
+    // Only take over SIGHUP if the application doesn't handle it.
+    struct sigaction previous;
+    sigaction(SIGHUP, NULL, &previous);
+    if(!(previous.sa_flags & SA_SIGINFO) &&
+        (previous.sa_handler == SIG_DFL || previous.sa_handler == SIG_IGN)) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = reload_signal_handler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGHUP, &action, NULL);
+    } else {
+        fprintf(stderr, "SIGHUP is handled by the application, plugins reload on file changes only\n");
+    }
+
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, watch_thread_main, NULL) != 0) {
+        fprintf(stderr, "Failed to start plugin watch thread\n");
+        return;
+    }
+    pthread_detach(thread);
+    g_watch_thread_running = true;
+}
+
+void egl_wrapper_load_plugins(const char* plugin_list, const char* config_path, bool watch) {
+    pthread_mutex_lock(&g_reload_lock);
+    free(g_plugin_list);
+    free(g_config_path);
+    g_plugin_list = plugin_list != NULL ? strdup(plugin_list) : NULL;
+    g_config_path = config_path != NULL ? strdup(config_path) : NULL;
+    pthread_mutex_unlock(&g_reload_lock);
+
+    egl_wrapper_reload_plugins();
+
+    if(watch) {
+        pthread_mutex_lock(&g_reload_lock);
+        start_watching();
+        pthread_mutex_unlock(&g_reload_lock);
+    }
+}
+
+void plugins_init_from_env(void) {
+    const char* plugin_list = getenv("EGL_WRAPPER_PLUGINS");
+    const char* config_path = getenv("EGL_WRAPPER_PLUGIN_CONFIG");
+    if(plugin_list == NULL && config_path == NULL) {
+        return;
+    }
+    egl_wrapper_load_plugins(plugin_list, config_path, true);
+}
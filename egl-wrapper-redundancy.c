@@ -0,0 +1,360 @@
+// This file implements the redundant-call analysis: detecting EGL calls
+// which could have been left out, and how much time they cost, per frame
+// and per call site.
+
+#define _GNU_SOURCE
+
+#include "egl-wrapper-internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+// Call sites are keyed by (return address, kind of call).
+#define MAX_CALL_SITES 512
+// Names passed to eglGetProcAddress.
+#define MAX_PROC_NAMES 1024
+// Per-thread cache of query results.
+#define QUERY_CACHE_SIZE 32
+#define REPORT_MAX_SITES 20
+
+// Types
+typedef struct {
+    egl_wrapper_redundant_call kind;
+    EGLDisplay dpy;
+    void* object;           // surface or config
+    EGLint attribute;
+    EGLint value;
+} cached_query;
+
+typedef struct {
+    // Current binding, as last set through eglMakeCurrent.
+    bool have_binding;
+    EGLDisplay dpy;
+    EGLSurface draw;
+    EGLSurface read;
+    EGLContext ctx;
+
+    // Last swap interval set, and for which surface.
+    bool have_interval;
+    EGLDisplay interval_dpy;
+    EGLSurface interval_surface;
+    EGLint interval;
+
+    // Whether the last call was an eglGetError returning EGL_SUCCESS.
+    bool last_error_was_success;
+
+    cached_query queries[QUERY_CACHE_SIZE];
+    unsigned int num_queries;
+    unsigned int next_query;
+
+    egl_wrapper_redundancy_frame frame;
+} thread_state;
+
+// Globals
+_Atomic bool g_redundancy_enabled = false;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static egl_wrapper_redundancy_site g_sites[MAX_CALL_SITES];
+static uint64_t g_proc_names[MAX_PROC_NAMES];
+static unsigned int g_num_proc_names = 0;
+static egl_wrapper_redundancy_stats g_stats;
+static void (*g_frame_callback)(const egl_wrapper_redundancy_frame*) = NULL;
+
+static __thread thread_state t_state;
+
+static const char* const g_kind_names[EGL_WRAPPER_REDUNDANT_NUM_KINDS] = {
+    "eglMakeCurrent",
+    "eglQuerySurface",
+    "eglGetConfigAttrib",
+    "eglGetProcAddress",
+    "eglGetError",
+    "eglSwapInterval"
+};
+
+void egl_wrapper_enable_redundancy_analysis(bool enable) {
+    g_redundancy_enabled = enable;
+}
+
+void egl_wrapper_set_redundancy_frame_callback(void (*callback)(const egl_wrapper_redundancy_frame* frame)) {
+    pthread_mutex_lock(&g_lock);
+    g_frame_callback = callback;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void egl_wrapper_get_redundancy_stats(egl_wrapper_redundancy_stats* stats) {
+    pthread_mutex_lock(&g_lock);
+    *stats = g_stats;
+    pthread_mutex_unlock(&g_lock);
+}
+
+static int compare_sites(const void* a, const void* b) {
+    const egl_wrapper_redundancy_site* site_a = a;
+    const egl_wrapper_redundancy_site* site_b = b;
+    if(site_a->wasted_ns != site_b->wasted_ns) {
+        return site_a->wasted_ns < site_b->wasted_ns ? 1 : -1;
+    }
+    return site_a->redundant < site_b->redundant ? 1 : site_a->redundant > site_b->redundant ? -1 : 0;
+}
+
+unsigned int egl_wrapper_get_redundancy_sites(egl_wrapper_redundancy_site* sites, unsigned int max_sites) {
+    egl_wrapper_redundancy_site* sorted = malloc(sizeof(g_sites));
+    if(sorted == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&g_lock);
+    unsigned int num_sites = 0;
+    for(unsigned int i = 0; i < MAX_CALL_SITES; i++) {
+        if(g_sites[i].call_site != NULL) {
+            sorted[num_sites++] = g_sites[i];
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    qsort(sorted, num_sites, sizeof(*sorted), compare_sites);
+    unsigned int n = num_sites < max_sites ? num_sites : max_sites;
+    memcpy(sites, sorted, n * sizeof(*sites));
+    free(sorted);
+    return n;
+}
+
+void egl_wrapper_print_redundancy_report(void) {
+    egl_wrapper_redundancy_stats stats;
+    egl_wrapper_get_redundancy_stats(&stats);
+
+    printf("Redundant EGL calls over %llu frame(s):\n", stats.frames);
+    for(int kind = 0; kind < EGL_WRAPPER_REDUNDANT_NUM_KINDS; kind++) {
+        printf("  %-20s %10llu of %10llu calls redundant, %10.3f ms wasted\n",
+            g_kind_names[kind], stats.redundant[kind], stats.calls[kind],
+            stats.wasted_ns[kind] / 1e6);
+    }
+    if(stats.frames > 0) {
+        printf("  per frame: %.2f redundant call(s), %.3f ms wasted on average; worst frame %llu with %.3f ms\n",
+            (double)stats.total_redundant / stats.frames,
+            stats.total_wasted_ns / 1e6 / stats.frames,
+            stats.worst_frame, stats.worst_frame_wasted_ns / 1e6);
+    }
+
+    egl_wrapper_redundancy_site sites[REPORT_MAX_SITES];
+    unsigned int num_sites = egl_wrapper_get_redundancy_sites(sites, REPORT_MAX_SITES);
+    if(num_sites > 0 && sites[0].redundant > 0) {
+        printf("Call sites with redundant calls:\n");
+    }
+    for(unsigned int i = 0; i < num_sites && sites[i].redundant > 0; i++) {
+        Dl_info info;
+        char where[512];
+        if(dladdr(sites[i].call_site, &info) != 0 && info.dli_fname != NULL) {
+            const char* object = strrchr(info.dli_fname, '/');
+            object = object != NULL ? object + 1 : info.dli_fname;
+            if(info.dli_sname != NULL) {
+                snprintf(where, sizeof(where), "%s(%s+0x%lx)", object, info.dli_sname,
+                    (unsigned long)((char*)sites[i].call_site - (char*)info.dli_saddr));
+            } else {
+                snprintf(where, sizeof(where), "%s(+0x%lx)", object,
+                    (unsigned long)((char*)sites[i].call_site - (char*)info.dli_fbase));
+            }
+        } else {
+            snprintf(where, sizeof(where), "%p", sites[i].call_site);
+        }
+        printf("  %-20s %10llu of %10llu calls redundant, %10.3f ms wasted at %s\n",
+            g_kind_names[sites[i].kind], sites[i].redundant, sites[i].calls,
+            sites[i].wasted_ns / 1e6, where);
+    }
+}
+
+void redundancy_init_from_env(void) {
+    const char* enable = getenv("EGL_WRAPPER_REDUNDANCY_REPORT");
+    if(enable == NULL || atoi(enable) == 0) {
+        return;
+    }
+    egl_wrapper_enable_redundancy_analysis(true);
+    atexit(egl_wrapper_print_redundancy_report);
+    printf("Redundant call analysis enabled\n");
+}
+
+// Must be called with g_lock held. Returns NULL if the table is full.
+static egl_wrapper_redundancy_site* lookup_site(void* call_site, egl_wrapper_redundant_call kind) {
+    uintptr_t hash = ((uintptr_t)call_site >> 2) * 31 + (uintptr_t)kind;
+    for(unsigned int probe = 0; probe < MAX_CALL_SITES; probe++) {
+        egl_wrapper_redundancy_site* site = &g_sites[(hash + probe) % MAX_CALL_SITES];
+        if(site->call_site == call_site && site->kind == kind) {
+            return site;
+        }
+        if(site->call_site == NULL) {
+            site->call_site = call_site;
+            site->kind = kind;
+            return site;
+        }
+    }
+    return NULL;
+}
+
+static void record(egl_wrapper_redundant_call kind, void* call_site, uint64_t start_ns, bool redundant) {
+    // start_ns is 0 if the analysis was enabled during the call.
+    uint64_t duration = start_ns != 0 ? egl_wrapper_now_ns() - start_ns : 0;
+
+    egl_wrapper_redundancy_frame* frame = &t_state.frame;
+    frame->calls[kind]++;
+    if(redundant) {
+        frame->redundant[kind]++;
+        frame->wasted_ns += duration;
+    }
+
+    pthread_mutex_lock(&g_lock);
+    g_stats.calls[kind]++;
+    if(redundant) {
+        g_stats.redundant[kind]++;
+        g_stats.wasted_ns[kind] += duration;
+        g_stats.total_redundant++;
+        g_stats.total_wasted_ns += duration;
+    }
+    egl_wrapper_redundancy_site* site = lookup_site(call_site, kind);
+    if(site != NULL) {
+        site->calls++;
+        site->total_ns += duration;
+        if(redundant) {
+            site->redundant++;
+            site->wasted_ns += duration;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+// Returns true if the same query already returned the same value.
+// Otherwise, remembers the result.
+static bool check_query(egl_wrapper_redundant_call kind, EGLDisplay dpy, void* object, EGLint attribute, EGLint value) {
+    thread_state* state = &t_state;
+    for(unsigned int i = 0; i < state->num_queries; i++) {
+        cached_query* query = &state->queries[i];
+        if(query->kind == kind && query->dpy == dpy && query->object == object && query->attribute == attribute) {
+            bool same = query->value == value;
+            query->value = value;
+            return same;
+        }
+    }
+    cached_query* query = &state->queries[state->next_query];
+    state->next_query = (state->next_query + 1) % QUERY_CACHE_SIZE;
+    if(state->num_queries < QUERY_CACHE_SIZE) {
+        state->num_queries++;
+    }
+    query->kind = kind;
+    query->dpy = dpy;
+    query->object = object;
+    query->attribute = attribute;
+    query->value = value;
+    return false;
+}
+
+void redundancy_make_current(void* call_site, uint64_t start_ns, EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx, EGLBoolean result) {
+    thread_state* state = &t_state;
+    bool redundant = result == EGL_TRUE && state->have_binding &&
+        state->dpy == dpy && state->draw == draw && state->read == read && state->ctx == ctx;
+    if(result == EGL_TRUE) {
+        state->have_binding = true;
+        state->dpy = dpy;
+        state->draw = draw;
+        state->read = read;
+        state->ctx = ctx;
+    }
+    record(EGL_WRAPPER_REDUNDANT_MAKE_CURRENT, call_site, start_ns, redundant);
+}
+
+void redundancy_query_surface(void* call_site, uint64_t start_ns, EGLDisplay dpy, EGLSurface surface, EGLint attribute, const EGLint* value, EGLBoolean result) {
+    bool redundant = result == EGL_TRUE && value != NULL &&
+        check_query(EGL_WRAPPER_REDUNDANT_QUERY_SURFACE, dpy, surface, attribute, *value);
+    record(EGL_WRAPPER_REDUNDANT_QUERY_SURFACE, call_site, start_ns, redundant);
+}
+
+void redundancy_get_config_attrib(void* call_site, uint64_t start_ns, EGLDisplay dpy, EGLConfig config, EGLint attribute, const EGLint* value, EGLBoolean result) {
+    bool redundant = result == EGL_TRUE && value != NULL &&
+        check_query(EGL_WRAPPER_REDUNDANT_GET_CONFIG_ATTRIB, dpy, config, attribute, *value);
+    record(EGL_WRAPPER_REDUNDANT_GET_CONFIG_ATTRIB, call_site, start_ns, redundant);
+}
+
+void redundancy_get_proc_address(void* call_site, uint64_t start_ns, const char* proc_name) {
+    // Names are remembered by their 64-bit FNV-1a hash.
+    uint64_t hash = 14695981039346656037ull;
+    for(const char* c = proc_name; c != NULL && *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+    }
+    hash = hash != 0 ? hash : 1;
+
+    bool redundant = false;
+    pthread_mutex_lock(&g_lock);
+    for(unsigned int probe = 0; probe < MAX_PROC_NAMES; probe++) {
+        uint64_t* slot = &g_proc_names[(hash + probe) % MAX_PROC_NAMES];
+        if(*slot == hash) {
+            redundant = true;
+            break;
+        }
+        if(*slot == 0) {
+            // Stop remembering new names when the table is nearly full.
+            if(g_num_proc_names < MAX_PROC_NAMES * 3 / 4) {
+                *slot = hash;
+                g_num_proc_names++;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    record(EGL_WRAPPER_REDUNDANT_GET_PROC_ADDRESS, call_site, start_ns, redundant);
+}
+
+void redundancy_get_error(void* call_site, uint64_t start_ns, EGLint result) {
+    thread_state* state = &t_state;
+    bool redundant = result == EGL_SUCCESS && state->last_error_was_success;
+    state->last_error_was_success = result == EGL_SUCCESS;
+    record(EGL_WRAPPER_REDUNDANT_GET_ERROR, call_site, start_ns, redundant);
+}
+
+void redundancy_other_call(void) {
+    t_state.last_error_was_success = false;
+}
+
+void redundancy_swap_interval(void* call_site, uint64_t start_ns, EGLDisplay dpy, EGLint interval, EGLBoolean result) {
+    // The interval applies to the draw surface of the current context.
+    thread_state* state = &t_state;
+    EGLSurface surface = state->have_binding ? state->draw : EGL_NO_SURFACE;
+    bool redundant = result == EGL_TRUE && state->have_interval &&
+        state->interval_dpy == dpy && state->interval_surface == surface &&
+        state->interval == interval;
+    if(result == EGL_TRUE) {
+        state->have_interval = true;
+        state->interval_dpy = dpy;
+        state->interval_surface = surface;
+        state->interval = interval;
+    }
+    record(EGL_WRAPPER_REDUNDANT_SWAP_INTERVAL, call_site, start_ns, redundant);
+}
+
+void redundancy_end_frame(void) {
+    thread_state* state = &t_state;
+
+    // Surface attributes may change between frames (e.g. on resize),
+    // config attributes can't.
+    unsigned int kept = 0;
+    for(unsigned int i = 0; i < state->num_queries; i++) {
+        if(state->queries[i].kind != EGL_WRAPPER_REDUNDANT_QUERY_SURFACE) {
+            state->queries[kept++] = state->queries[i];
+        }
+    }
+    state->num_queries = kept;
+    state->next_query = kept % QUERY_CACHE_SIZE;
+    state->last_error_was_success = false;
+
+    pthread_mutex_lock(&g_lock);
+    state->frame.frame = g_stats.frames++;
+    if(state->frame.wasted_ns > g_stats.worst_frame_wasted_ns) {
+        g_stats.worst_frame_wasted_ns = state->frame.wasted_ns;
+        g_stats.worst_frame = state->frame.frame;
+    }
+    void (*callback)(const egl_wrapper_redundancy_frame*) = g_frame_callback;
+    pthread_mutex_unlock(&g_lock);
+
+    if(callback != NULL) {
+        callback(&state->frame);
+    }
+    memset(&state->frame, 0, sizeof(state->frame));
+}
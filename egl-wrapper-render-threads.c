@@ -0,0 +1,239 @@
+// This file implements the CPU affinity and scheduling policy applied to
+// render threads, and the tracking of which cores they run on.
+
+#define _GNU_SOURCE
+
+#include "egl-wrapper-internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define MAX_RENDER_THREADS 64
+
+// Globals
+_Atomic bool g_render_threads_enabled = false;
+
+static egl_wrapper_render_thread_policy g_policy;
+static cpu_set_t g_cpu_set;
+static bool g_have_cpu_set = false;
+
+// Records of the live render threads. Each is owned by its thread, and
+// freed when the thread exits.
+static egl_wrapper_render_thread_info* g_threads[MAX_RENDER_THREADS];
+static unsigned int g_num_threads = 0;
+static pthread_mutex_t g_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_thread_key;
+static pthread_once_t g_thread_key_once = PTHREAD_ONCE_INIT;
+
+// Record of the calling thread, NULL until its first eglMakeCurrent (or
+// if there was no room for it).
+static __thread egl_wrapper_render_thread_info* t_thread_info = NULL;
+static __thread bool t_policy_applied = false;
+
+// Parse a CPU list such as "0-3,8,10-11" into a cpu_set_t.
+static bool parse_cpu_list(const char* list, cpu_set_t* set) {
+    CPU_ZERO(set);
+    const char* p = list;
+    while(*p != '\0') {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if(end == p || first < 0) {
+            return false;
+        }
+        p = end;
+        if(*p == '-') {
+            p++;
+            last = strtol(p, &end, 10);
+            if(end == p || last < first) {
+                return false;
+            }
+            p = end;
+        }
+        for(long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        if(*p == ',') {
+            p++;
+        } else if(*p != '\0') {
+            return false;
+        }
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+void egl_wrapper_set_render_thread_policy(const egl_wrapper_render_thread_policy* policy) {
+    pthread_mutex_lock(&g_threads_lock);
+    if(policy == NULL) {
+        memset(&g_policy, 0, sizeof(g_policy));
+        g_have_cpu_set = false;
+        g_render_threads_enabled = false;
+        pthread_mutex_unlock(&g_threads_lock);
+        return;
+    }
+    g_policy = *policy;
+    g_have_cpu_set = false;
+    if(policy->cpus != NULL) {
+        g_have_cpu_set = parse_cpu_list(policy->cpus, &g_cpu_set);
+        if(!g_have_cpu_set) {
+            fprintf(stderr, "Invalid render thread CPU list: %s\n", policy->cpus);
+        }
+    }
+    // The string is not needed anymore after parsing.
+    g_policy.cpus = NULL;
+    g_render_threads_enabled = true;
+    pthread_mutex_unlock(&g_threads_lock);
+}
+
+unsigned int egl_wrapper_get_render_threads(egl_wrapper_render_thread_info* threads, unsigned int max_threads) {
+    pthread_mutex_lock(&g_threads_lock);
+    unsigned int n = g_num_threads < max_threads ? g_num_threads : max_threads;
+    for(unsigned int i = 0; i < n; i++) {
+        threads[i] = *g_threads[i];
+    }
+    pthread_mutex_unlock(&g_threads_lock);
+    return n;
+}
+
+static bool is_sched_name(const char* sched, size_t len, const char* name) {
+    return strlen(name) == len && strncmp(sched, name, len) == 0;
+}
+
+void render_threads_init_from_env(void) {
+    const char* cpus = getenv("EGL_WRAPPER_RENDER_CPUS");
+    const char* nice_level = getenv("EGL_WRAPPER_RENDER_NICE");
+    const char* sched = getenv("EGL_WRAPPER_RENDER_SCHED");
+
+    if(cpus == NULL && nice_level == NULL && sched == NULL) {
+        return;
+    }
+
+    egl_wrapper_render_thread_policy policy = {
+        .cpus = cpus,
+        .set_nice = nice_level != NULL,
+        .nice = nice_level != NULL ? atoi(nice_level) : 0,
+        .sched_policy = EGL_WRAPPER_SCHED_UNCHANGED,
+        .sched_priority = 0
+    };
+
+    // Format: "fifo:<priority>", "rr:<priority>" or "other".
+    if(sched != NULL) {
+        const char* priority = strchr(sched, ':');
+        size_t name_len = priority != NULL ? (size_t)(priority - sched) : strlen(sched);
+        if(is_sched_name(sched, name_len, "fifo")) {
+            policy.sched_policy = EGL_WRAPPER_SCHED_FIFO;
+        } else if(is_sched_name(sched, name_len, "rr")) {
+            policy.sched_policy = EGL_WRAPPER_SCHED_RR;
+        } else if(is_sched_name(sched, name_len, "other") && priority == NULL) {
+            policy.sched_policy = EGL_WRAPPER_SCHED_OTHER;
+        } else {
+            fprintf(stderr, "Unknown EGL_WRAPPER_RENDER_SCHED: %s\n", sched);
+        }
+        policy.sched_priority = priority != NULL ? atoi(priority + 1) : 1;
+    }
+
+    egl_wrapper_set_render_thread_policy(&policy);
+    printf("Render thread policy: cpus %s, nice %s, sched %s\n",
+        cpus != NULL ? cpus : "unchanged",
+        nice_level != NULL ? nice_level : "unchanged",
+        sched != NULL ? sched : "unchanged");
+}
+
+// Must be called with g_threads_lock held.
+static void apply_policy(egl_wrapper_render_thread_info* info) {
+    if(g_have_cpu_set) {
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(g_cpu_set), &g_cpu_set);
+        if(err != 0) {
+            fprintf(stderr, "Failed to set render thread affinity: %s\n", strerror(err));
+        }
+        info->pinned = err == 0;
+    }
+    if(g_policy.set_nice) {
+        // On Linux, the nice level is per thread.
+        if(setpriority(PRIO_PROCESS, (id_t)info->tid, g_policy.nice) != 0) {
+            fprintf(stderr, "Failed to set render thread nice level: %s\n", strerror(errno));
+        }
+    }
+    if(g_policy.sched_policy != EGL_WRAPPER_SCHED_UNCHANGED) {
+        int policy =
+            g_policy.sched_policy == EGL_WRAPPER_SCHED_FIFO ? SCHED_FIFO :
+            g_policy.sched_policy == EGL_WRAPPER_SCHED_RR ? SCHED_RR :
+            SCHED_OTHER;
+        struct sched_param param = {
+            .sched_priority = policy == SCHED_OTHER ? 0 : g_policy.sched_priority
+        };
+        int err = pthread_setschedparam(pthread_self(), policy, &param);
+        if(err != 0) {
+            fprintf(stderr, "Failed to set render thread scheduling policy: %s\n", strerror(err));
+        }
+    }
+}
+
+static void remove_thread(void* arg) {
+    egl_wrapper_render_thread_info* info = arg;
+    pthread_mutex_lock(&g_threads_lock);
+    for(unsigned int i = 0; i < g_num_threads; i++) {
+        if(g_threads[i] == info) {
+            g_threads[i] = g_threads[--g_num_threads];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_threads_lock);
+    free(info);
+}
+
+static void create_thread_key(void) {
+    pthread_key_create(&g_thread_key, remove_thread);
+}
+
+void render_threads_after_make_current(void) {
+    if(t_policy_applied) {
+        return;
+    }
+    t_policy_applied = true;
+    pthread_once(&g_thread_key_once, create_thread_key);
+
+    egl_wrapper_render_thread_info record;
+    memset(&record, 0, sizeof(record));
+    record.tid = (int)syscall(SYS_gettid);
+
+    pthread_mutex_lock(&g_threads_lock);
+    // The policy applies to every render thread, even those for which
+    // there is no room to record them.
+    apply_policy(&record);
+    record.first_cpu = sched_getcpu();
+    record.last_cpu = record.first_cpu;
+    egl_wrapper_render_thread_info* info = NULL;
+    if(g_num_threads < MAX_RENDER_THREADS && (info = malloc(sizeof(*info))) != NULL) {
+        *info = record;
+        g_threads[g_num_threads++] = info;
+        t_thread_info = info;
+    }
+    pthread_mutex_unlock(&g_threads_lock);
+    if(info != NULL) {
+        pthread_setspecific(g_thread_key, info);
+    }
+}
+
+void render_threads_after_swap(void) {
+    egl_wrapper_render_thread_info* info = t_thread_info;
+    if(info == NULL) {
+        return;
+    }
+    // Only this thread writes its record, so the lock is only needed
+    // when it changes.
+    int cpu = sched_getcpu();
+    if(cpu != info->last_cpu) {
+        pthread_mutex_lock(&g_threads_lock);
+        info->last_cpu = cpu;
+        info->migrations++;
+        pthread_mutex_unlock(&g_threads_lock);
+    }
+}
@@ -0,0 +1,259 @@
+// This file implements hooks scoped to a context, surface, display or
+// thread.
+//
+// Each thread keeps the hooks which apply to it, merged from all the
+// scopes matching its current binding, in a thread-local table. The
+// exported functions only look at the thread-local pointer to it
+// (t_scoped_hooks), which is NULL when no scope applies. The table is
+// recomputed by the thread itself: after each eglMakeCurrent, and when
+// another thread changes the scoped hooks and marks the pointer stale.
+//
+// Threads are only registered (to be marked stale) once scoped hooks
+// exist: until then, calls don't leave the fast path. A thread which
+// isn't registered yet when the first scoped hooks appear registers on
+// its next call, as it sees g_scoped_hooks_used.
+
+#define _GNU_SOURCE
+
+#include "egl-wrapper-internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define MAX_SCOPES 64
+
+// Types
+typedef struct {
+    egl_wrapper_scope scope;
+    void* object;
+    egl_wrapper_plugin_hooks hooks;
+} scope_entry;
+
+typedef struct thread_node {
+    struct thread_node* next;
+    intptr_t tid;
+    const egl_wrapper_plugin_hooks* _Atomic* slot;
+} thread_node;
+
+typedef struct {
+    bool known;
+    EGLDisplay dpy;
+    EGLSurface draw;
+    EGLSurface read;
+    EGLContext ctx;
+} thread_binding;
+
+// Globals
+
+// Never called through: only marks a thread's table as out of date.
+static const egl_wrapper_plugin_hooks g_stale_hooks;
+
+__thread const egl_wrapper_plugin_hooks* _Atomic t_scoped_hooks = NULL;
+__thread bool t_scoped_hooks_registered = false;
+_Atomic bool g_scoped_hooks_used = false;
+
+static scope_entry g_scopes[MAX_SCOPES];
+static unsigned int g_num_scopes = 0;
+static thread_node* g_threads = NULL;
+static pthread_mutex_t g_scopes_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_thread_key;
+static pthread_once_t g_thread_key_once = PTHREAD_ONCE_INIT;
+
+static __thread thread_node* t_node = NULL;
+static __thread thread_binding t_binding;
+static __thread egl_wrapper_plugin_hooks t_merged;
+
+static void mark_all_stale(void) {
+    for(thread_node* node = g_threads; node != NULL; node = node->next) {
+        *node->slot = &g_stale_hooks;
+    }
+}
+
+static void unregister_thread(void* arg) {
+    thread_node* node = arg;
+    pthread_mutex_lock(&g_scopes_lock);
+    for(thread_node** p = &g_threads; *p != NULL; p = &(*p)->next) {
+        if(*p == node) {
+            *p = node->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_scopes_lock);
+    free(node);
+}
+
+static void create_thread_key(void) {
+    pthread_key_create(&g_thread_key, unregister_thread);
+}
+
+static intptr_t current_tid(void) {
+    return (intptr_t)syscall(SYS_gettid);
+}
+
+// Called with g_scopes_lock held.
+static void register_thread(void) {
+    thread_node* node = malloc(sizeof(*node));
+    if(node == NULL) {
+        return;
+    }
+    node->tid = current_tid();
+    node->slot = &t_scoped_hooks;
+    node->next = g_threads;
+    g_threads = node;
+    t_node = node;
+    t_scoped_hooks_registered = true;
+    pthread_setspecific(g_thread_key, node);
+}
+
+static const scope_entry* find_scope(egl_wrapper_scope scope, void* object) {
+    if(object == NULL) {
+        return NULL;
+    }
+    for(unsigned int i = 0; i < g_num_scopes; i++) {
+        if(g_scopes[i].scope == scope && g_scopes[i].object == object) {
+            return &g_scopes[i];
+        }
+    }
+    return NULL;
+}
+
+// Called with g_scopes_lock held.
+static const egl_wrapper_plugin_hooks* merge_scopes(void) {
+    // From the most specific scope to the least.
+    const scope_entry* matches[5];
+    unsigned int num_matches = 0;
+    const scope_entry* entry;
+    if(t_binding.known) {
+        if((entry = find_scope(EGL_WRAPPER_SCOPE_CONTEXT, t_binding.ctx)) != NULL) {
+            matches[num_matches++] = entry;
+        }
+        if((entry = find_scope(EGL_WRAPPER_SCOPE_SURFACE, t_binding.draw)) != NULL) {
+            matches[num_matches++] = entry;
+        }
+        if(t_binding.read != t_binding.draw &&
+            (entry = find_scope(EGL_WRAPPER_SCOPE_SURFACE, t_binding.read)) != NULL) {
+            matches[num_matches++] = entry;
+        }
+        if((entry = find_scope(EGL_WRAPPER_SCOPE_DISPLAY, t_binding.dpy)) != NULL) {
+            matches[num_matches++] = entry;
+        }
+    }
+    intptr_t tid = t_node != NULL ? t_node->tid : current_tid();
+    if((entry = find_scope(EGL_WRAPPER_SCOPE_THREAD, (void*)tid)) != NULL) {
+        matches[num_matches++] = entry;
+    }
+    if(num_matches == 0) {
+        return NULL;
+    }
+
+    memset(&t_merged, 0, sizeof(t_merged));
+#define MERGE_ENTRY(F) \
+    for(unsigned int i = 0; i < num_matches && t_merged.egl##F == NULL; i++) { \
+        t_merged.egl##F = matches[i]->hooks.egl##F; \
+    }
+    EGL_WRAPPER_ENTRIES(MERGE_ENTRY)
+#undef MERGE_ENTRY
+    return &t_merged;
+}
+
+// For a thread whose binding was made before any scoped hooks were
+// registered, and so wasn't recorded.
+static void query_binding(void) {
+    if(g_num_libraries == 0) {
+        return;
+    }
+    egl_dispatch_table* table = dispatch_for_thread();
+    t_binding.ctx = table->eglGetCurrentContext();
+    t_binding.dpy = table->eglGetCurrentDisplay();
+    t_binding.draw = table->eglGetCurrentSurface(EGL_DRAW);
+    t_binding.read = table->eglGetCurrentSurface(EGL_READ);
+    t_binding.known = true;
+}
+
+const egl_wrapper_plugin_hooks* scoped_hooks_for_thread(bool query) {
+    const egl_wrapper_plugin_hooks* hooks = t_scoped_hooks;
+    if(hooks != &g_stale_hooks && t_node != NULL) {
+        return hooks;
+    }
+    if(!t_binding.known && !query) {
+        // The driver's getters may clear its error (e.g. for eglGetError).
+        pthread_mutex_lock(&g_scopes_lock);
+        hooks = merge_scopes();
+        pthread_mutex_unlock(&g_scopes_lock);
+        return hooks;
+    }
+    pthread_once(&g_thread_key_once, create_thread_key);
+    if(!t_binding.known) {
+        query_binding();
+    }
+
+    pthread_mutex_lock(&g_scopes_lock);
+    if(t_node == NULL) {
+        register_thread();
+    }
+    hooks = merge_scopes();
+    t_scoped_hooks = hooks;
+    pthread_mutex_unlock(&g_scopes_lock);
+    return hooks;
+}
+
+void scoped_hooks_after_make_current(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx) {
+    t_binding.known = true;
+    t_binding.dpy = ctx != EGL_NO_CONTEXT ? dpy : EGL_NO_DISPLAY;
+    t_binding.draw = draw;
+    t_binding.read = read;
+    t_binding.ctx = ctx;
+
+    pthread_once(&g_thread_key_once, create_thread_key);
+    pthread_mutex_lock(&g_scopes_lock);
+    if(t_node == NULL) {
+        register_thread();
+    }
+    t_scoped_hooks = merge_scopes();
+    pthread_mutex_unlock(&g_scopes_lock);
+}
+
+bool egl_wrapper_register_scoped_hooks(egl_wrapper_scope scope, void* object, const egl_wrapper_plugin_hooks* hooks) {
+    if(scope == EGL_WRAPPER_SCOPE_THREAD && object == NULL) {
+        object = (void*)current_tid();
+    }
+    if(object == NULL || hooks == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&g_scopes_lock);
+    scope_entry* entry = (scope_entry*)find_scope(scope, object);
+    if(entry == NULL) {
+        if(g_num_scopes == MAX_SCOPES) {
+            pthread_mutex_unlock(&g_scopes_lock);
+            fprintf(stderr, "Too many scoped hooks\n");
+            return false;
+        }
+        entry = &g_scopes[g_num_scopes++];
+        entry->scope = scope;
+        entry->object = object;
+    }
+    entry->hooks = *hooks;
+    g_scoped_hooks_used = true;
+    mark_all_stale();
+    pthread_mutex_unlock(&g_scopes_lock);
+    return true;
+}
+
+void egl_wrapper_unregister_scoped_hooks(egl_wrapper_scope scope, void* object) {
+    if(scope == EGL_WRAPPER_SCOPE_THREAD && object == NULL) {
+        object = (void*)current_tid();
+    }
+
+    pthread_mutex_lock(&g_scopes_lock);
+    const scope_entry* entry = find_scope(scope, object);
+    if(entry != NULL) {
+        g_scopes[entry - g_scopes] = g_scopes[--g_num_scopes];
+        mark_all_stale();
+    }
+    pthread_mutex_unlock(&g_scopes_lock);
+}
@@ -1,23 +1,54 @@
 // This file concerns the dynamic loading of the underlying EGL implementation.
 
-#include "egl-wrapper.h"
+#include "egl-wrapper-internal.h"
 
 #include <stdlib.h>
 #include <dlfcn.h>
 #include <stdio.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
 
 // Preprocessor utilities
-#define CHECK_FUNC_PTR_AND_INIT(F) \
-    if(*F == NULL) { \
+#define CHECK_INIT(F) \
+    if(g_init_state != INITIALIZED) { \
         egl_wrapper_first_contact(#F); \
-        if(*F == NULL) { \
+        if(g_init_state != INITIALIZED) { \
             fprintf(stderr, "Function " #F " is not initialized\n"); \
             exit(-1); \
         } \
     }
 
+// Declares hook as the hook to call for F: the one scoped to the calling
+// thread's binding if any, else the one of the plugins, else the
+// registered one (or NULL).
+#define RESOLVE_HOOK(F) RESOLVE_HOOK_QUERYING(F, true)
+
+// As RESOLVE_HOOK, but unless QUERY_BINDING, a binding of the thread which
+// isn't known yet isn't asked from the driver (see
+// scoped_hooks_for_thread).
+#define RESOLVE_HOOK_QUERYING(F, QUERY_BINDING) \
+    __typeof__(g_callback_##F) hook = g_plugin_callbacks.F != NULL ? g_plugin_callbacks.F : g_callback_##F; \
+    if(t_scoped_hooks != NULL || (g_scoped_hooks_used && !t_scoped_hooks_registered)) { \
+        const egl_wrapper_plugin_hooks* scoped = scoped_hooks_for_thread(QUERY_BINDING); \
+        if(scoped != NULL && scoped->F != NULL) { \
+            hook = scoped->F; \
+        } \
+    }
+
+// Applies the injection rules to a call of F, and returns FAILURE if an
+// error was injected. Every entry point but eglGetError starts with it,
+// so it also tells the redundancy analysis that the call separates two
+// eglGetError polls.
+#define INJECT(F, FAILURE) \
+    if(g_redundancy_enabled) { \
+        redundancy_other_call(); \
+    } \
+    if(g_injection_enabled && injection_before_call(INJECTION_##F) != EGL_SUCCESS) { \
+        return FAILURE; \
+    }
+
 // Types
 typedef enum {
     NOT_INITIALIZED = 0,
@@ -27,43 +58,39 @@ typedef enum {
 
 // Globals
 volatile _Atomic init_state g_init_state = NOT_INITIALIZED;
-void * _Atomic g_egl_handle = NULL;
-
-// bare EGL API function pointers
-EGLint (*g_eglGetError)(void) = NULL;
-EGLDisplay (*g_eglGetDisplay)(EGLNativeDisplayType) = NULL;
-EGLBoolean (*g_eglInitialize)(EGLDisplay, EGLint *, EGLint *) = NULL;
-EGLBoolean (*g_eglTerminate)(EGLDisplay) = NULL;
-const char * (*g_eglQueryString)(EGLDisplay, EGLint) = NULL;
-EGLBoolean (*g_eglGetConfigs)(EGLDisplay, EGLConfig *, EGLint, EGLint *) = NULL;
-EGLBoolean (*g_eglChooseConfig)(EGLDisplay, const EGLint *, EGLConfig *, EGLint, EGLint *) = NULL;
-EGLBoolean (*g_eglGetConfigAttrib)(EGLDisplay, EGLConfig, EGLint, EGLint *) = NULL;
-EGLSurface (*g_eglCreateWindowSurface)(EGLDisplay, EGLConfig, EGLNativeWindowType, const EGLint *) = NULL;
-EGLSurface (*g_eglCreatePbufferSurface)(EGLDisplay, EGLConfig, const EGLint *) = NULL;
-EGLSurface (*g_eglCreatePixmapSurface)(EGLDisplay, EGLConfig, EGLNativePixmapType, const EGLint *) = NULL;
-EGLBoolean (*g_eglDestroySurface)(EGLDisplay, EGLSurface);
-EGLBoolean (*g_eglQuerySurface)(EGLDisplay, EGLSurface, EGLint, EGLint *) = NULL;
-EGLBoolean (*g_eglBindAPI)(EGLenum ) = NULL;
-EGLenum (*g_eglQueryAPI)(void) = NULL;
-EGLBoolean (*g_eglWaitClient)(void) = NULL;
-EGLBoolean (*g_eglReleaseThread)(void) = NULL;
-EGLSurface (*g_eglCreatePbufferFromClientBuffer)(EGLDisplay, EGLenum, EGLClientBuffer, EGLConfig, const EGLint *) = NULL;
-EGLBoolean (*g_eglSurfaceAttrib)(EGLDisplay, EGLSurface, EGLint, EGLint) = NULL;
-EGLBoolean (*g_eglBindTexImage)(EGLDisplay, EGLSurface, EGLint) = NULL;
-EGLBoolean (*g_eglReleaseTexImage)(EGLDisplay, EGLSurface, EGLint) = NULL;
-EGLBoolean (*g_eglSwapInterval)(EGLDisplay, EGLint) = NULL;
-EGLContext (*g_eglCreateContext)(EGLDisplay, EGLConfig, EGLContext, const EGLint *) = NULL;
-EGLBoolean (*g_eglDestroyContext)(EGLDisplay, EGLContext) = NULL;
-EGLBoolean (*g_eglMakeCurrent)(EGLDisplay, EGLSurface, EGLSurface, EGLContext) = NULL;
-EGLContext (*g_eglGetCurrentContext)(void) = NULL;
-EGLSurface (*g_eglGetCurrentSurface)(EGLint) = NULL;
-EGLDisplay (*g_eglGetCurrentDisplay)(void) = NULL;
-EGLBoolean (*g_eglQueryContext)(EGLDisplay, EGLContext, EGLint, EGLint *) = NULL;
-EGLBoolean (*g_eglWaitGL)(void) = NULL;
-EGLBoolean (*g_eglWaitNative)(EGLint) = NULL;
-EGLBoolean (*g_eglSwapBuffers)(EGLDisplay, EGLSurface) = NULL;
-EGLBoolean (*g_eglCopyBuffers)(EGLDisplay, EGLSurface, EGLNativePixmapType) = NULL;
-__eglMustCastToProperFunctionPointerType (*g_eglGetProcAddress)(const char*) = NULL;
+
+// Loaded EGL libraries. The first one is the default, used for any call
+// which can't be attributed to a display.
+egl_dispatch_table g_libraries[MAX_EGL_LIBRARIES];
+unsigned int g_num_libraries = 0;
+egl_wrapper_display_policy g_display_policy = EGL_WRAPPER_DISPLAY_POLICY_FIRST;
+_Atomic unsigned int g_next_library = 0;
+
+// Map of displays to the library which created them. Entries are only
+// appended (under g_display_map_lock), so it can be read without locking.
+struct {
+    EGLDisplay dpy;
+    egl_dispatch_table* library;
+} g_display_map[MAX_EGL_DISPLAYS];
+_Atomic unsigned int g_num_displays = 0;
+pthread_mutex_t g_display_map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Library of the context current on this thread, and library which
+// handled the last call from this thread (for eglGetError).
+__thread egl_dispatch_table* t_current_library = NULL;
+__thread egl_dispatch_table* t_last_library = NULL;
+// Error of the last call from this thread which failed in the wrapper
+// itself, reported by the next eglGetError.
+static __thread EGLint t_routing_error = EGL_SUCCESS;
+
+// Set when the wrapped library is already loaded and its functions are
+// looked up through a function rather than dlsym.
+const char* g_wrapped_lookup_name = NULL;
+egl_wrapper_symbol_lookup g_wrapped_lookup = NULL;
+void* g_wrapped_lookup_ctx = NULL;
+
+// Trampolines for the calls hooked by plugins, see egl-wrapper-plugins.c.
+egl_wrapper_plugin_hooks g_plugin_callbacks;
 
 // callbacks registered around bare EGL functions
 EGLint (*g_callback_eglGetError)(void) = NULL;
@@ -101,13 +128,468 @@ EGLBoolean (*g_callback_eglSwapBuffers)(EGLDisplay, EGLSurface) = NULL;
 EGLBoolean (*g_callback_eglCopyBuffers)(EGLDisplay, EGLSurface, EGLNativePixmapType) = NULL;
 __eglMustCastToProperFunctionPointerType (*g_callback_eglGetProcAddress)(const char*) = NULL;
 
+// Symbol lookup of a dlopen'd library.
+static void* lookup_dlsym(void* handle, const char* name) {
+    return dlsym(handle, name);
+}
+
+// Fill a dispatch table, looking up each function by name.
+static bool fill_dispatch_table(egl_dispatch_table* t, egl_wrapper_symbol_lookup lookup, void* ctx, const char* path) {
+    t->eglGetError = lookup(ctx, "eglGetError");
+    t->eglGetDisplay = lookup(ctx, "eglGetDisplay");
+    t->eglInitialize = lookup(ctx, "eglInitialize");
+    t->eglTerminate = lookup(ctx, "eglTerminate");
+    t->eglQueryString = lookup(ctx, "eglQueryString");
+    t->eglGetConfigs = lookup(ctx, "eglGetConfigs");
+    t->eglChooseConfig = lookup(ctx, "eglChooseConfig");
+    t->eglGetConfigAttrib = lookup(ctx, "eglGetConfigAttrib");
+    t->eglCreateWindowSurface = lookup(ctx, "eglCreateWindowSurface");
+    t->eglCreatePbufferSurface = lookup(ctx, "eglCreatePbufferSurface");
+    t->eglCreatePixmapSurface = lookup(ctx, "eglCreatePixmapSurface");
+    t->eglDestroySurface = lookup(ctx, "eglDestroySurface");
+    t->eglQuerySurface = lookup(ctx, "eglQuerySurface");
+    t->eglBindAPI = lookup(ctx, "eglBindAPI");
+    t->eglQueryAPI = lookup(ctx, "eglQueryAPI");
+    t->eglWaitClient = lookup(ctx, "eglWaitClient");
+    t->eglReleaseThread = lookup(ctx, "eglReleaseThread");
+    t->eglCreatePbufferFromClientBuffer = lookup(ctx, "eglCreatePbufferFromClientBuffer");
+    t->eglSurfaceAttrib = lookup(ctx, "eglSurfaceAttrib");
+    t->eglBindTexImage = lookup(ctx, "eglBindTexImage");
+    t->eglReleaseTexImage = lookup(ctx, "eglReleaseTexImage");
+    t->eglSwapInterval = lookup(ctx, "eglSwapInterval");
+    t->eglCreateContext = lookup(ctx, "eglCreateContext");
+    t->eglDestroyContext = lookup(ctx, "eglDestroyContext");
+    t->eglMakeCurrent = lookup(ctx, "eglMakeCurrent");
+    t->eglGetCurrentContext = lookup(ctx, "eglGetCurrentContext");
+    t->eglGetCurrentSurface = lookup(ctx, "eglGetCurrentSurface");
+    t->eglGetCurrentDisplay = lookup(ctx, "eglGetCurrentDisplay");
+    t->eglQueryContext = lookup(ctx, "eglQueryContext");
+    t->eglWaitGL = lookup(ctx, "eglWaitGL");
+    t->eglWaitNative = lookup(ctx, "eglWaitNative");
+    t->eglSwapBuffers = lookup(ctx, "eglSwapBuffers");
+    t->eglCopyBuffers = lookup(ctx, "eglCopyBuffers");
+    t->eglGetProcAddress = lookup(ctx, "eglGetProcAddress");
+
+    if(t->eglGetError == NULL ||
+        t->eglGetDisplay == NULL ||
+        t->eglInitialize == NULL ||
+        t->eglTerminate == NULL ||
+        t->eglQueryString == NULL ||
+        t->eglGetConfigs == NULL ||
+        t->eglChooseConfig == NULL ||
+        t->eglGetConfigAttrib == NULL ||
+        t->eglCreateWindowSurface == NULL ||
+        t->eglCreatePbufferSurface == NULL ||
+        t->eglCreatePixmapSurface == NULL ||
+        t->eglDestroySurface == NULL ||
+        t->eglQuerySurface == NULL ||
+        t->eglBindAPI == NULL ||
+        t->eglQueryAPI == NULL ||
+        t->eglWaitClient == NULL ||
+        t->eglReleaseThread == NULL ||
+        t->eglCreatePbufferFromClientBuffer == NULL ||
+        t->eglSurfaceAttrib == NULL ||
+        t->eglBindTexImage == NULL ||
+        t->eglReleaseTexImage == NULL ||
+        t->eglSwapInterval == NULL ||
+        t->eglCreateContext == NULL ||
+        t->eglDestroyContext == NULL ||
+        t->eglMakeCurrent == NULL ||
+        t->eglGetCurrentContext == NULL ||
+        t->eglGetCurrentSurface == NULL ||
+        t->eglGetCurrentDisplay == NULL ||
+        t->eglQueryContext == NULL ||
+        t->eglWaitGL == NULL ||
+        t->eglWaitNative == NULL ||
+        t->eglSwapBuffers == NULL ||
+        t->eglCopyBuffers == NULL ||
+        t->eglGetProcAddress == NULL
+    ) {
+        fprintf(stderr, "Failed to load all EGL API functions from %s\n", path);
+        return false;
+    }
+
+    t->index = g_num_libraries;
+    return true;
+}
+
+static bool load_library(egl_dispatch_table* t, const char* path) {
+    void* handle = dlopen(path, RTLD_LAZY);
+
+    if(handle == NULL) {
+        fprintf(stderr, "Failed to load wrapped EGL: %s\n", path);
+        return false;
+    }
+    if(!fill_dispatch_table(t, lookup_dlsym, handle, path)) {
+        return false;
+    }
+    t->handle = handle;
+    return true;
+}
+
+void set_wrapped_library_lookup(const char* name, egl_wrapper_symbol_lookup lookup, void* ctx) {
+    g_wrapped_lookup_name = name;
+    g_wrapped_lookup = lookup;
+    g_wrapped_lookup_ctx = ctx;
+}
+
+// The library owning a display, or NULL if it isn't known.
+static egl_dispatch_table* find_display(EGLDisplay dpy) {
+    unsigned int num_displays = atomic_load_explicit(&g_num_displays, memory_order_acquire);
+    for(unsigned int i = 0; i < num_displays; i++) {
+        if(g_display_map[i].dpy == dpy) {
+            return g_display_map[i].library;
+        }
+    }
+    return NULL;
+}
+
+static egl_dispatch_table* lookup_display(EGLDisplay dpy) {
+    egl_dispatch_table* library = find_display(dpy);
+    return library != NULL ? library : &g_libraries[0];
+}
+
+egl_dispatch_table* route_display(EGLDisplay dpy) {
+    egl_dispatch_table* library = lookup_display(dpy);
+    t_last_library = library;
+    t_routing_error = EGL_SUCCESS;
+    return library;
+}
+
+// Returns false if another library already handed out the same display
+// handle. Displays are routed by their handle alone, so the two could not
+// be told apart.
+static bool remember_display(EGLDisplay dpy, egl_dispatch_table* library) {
+    pthread_mutex_lock(&g_display_map_lock);
+    unsigned int num_displays = atomic_load(&g_num_displays);
+    for(unsigned int i = 0; i < num_displays; i++) {
+        if(g_display_map[i].dpy == dpy) {
+            egl_dispatch_table* owner = g_display_map[i].library;
+            pthread_mutex_unlock(&g_display_map_lock);
+            if(owner != library) {
+                fprintf(stderr, "EGL display %p of wrapped library %u is already used by wrapped library %u, "
+                    "failing eglGetDisplay\n", dpy, library->index, owner->index);
+                return false;
+            }
+            return true;
+        }
+    }
+    if(num_displays == MAX_EGL_DISPLAYS) {
+        fprintf(stderr, "Too many EGL displays, routing to the default library\n");
+    } else {
+        g_display_map[num_displays].dpy = dpy;
+        g_display_map[num_displays].library = library;
+        atomic_store_explicit(&g_num_displays, num_displays + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&g_display_map_lock);
+    return true;
+}
+
+// Choose the library for a new display according to the display policy.
+static egl_dispatch_table* choose_library(void) {
+    switch(g_display_policy) {
+    case EGL_WRAPPER_DISPLAY_POLICY_ROUND_ROBIN:
+        return &g_libraries[atomic_fetch_add(&g_next_library, 1) % g_num_libraries];
+    case EGL_WRAPPER_DISPLAY_POLICY_LEAST_CONTEXTS: {
+        egl_dispatch_table* best = &g_libraries[0];
+        for(unsigned int i = 1; i < g_num_libraries; i++) {
+            if(atomic_load(&g_libraries[i].num_contexts) < atomic_load(&best->num_contexts)) {
+                best = &g_libraries[i];
+            }
+        }
+        return best;
+    }
+    case EGL_WRAPPER_DISPLAY_POLICY_FIRST:
+    default:
+        return &g_libraries[0];
+    }
+}
+
+static EGLint route_eglGetError(void) {
+    if(t_routing_error != EGL_SUCCESS) {
+        EGLint error = t_routing_error;
+        t_routing_error = EGL_SUCCESS;
+        return error;
+    }
+    egl_dispatch_table* library = t_last_library != NULL ? t_last_library : &g_libraries[0];
+    return library->eglGetError();
+}
+
+static EGLDisplay route_eglGetDisplay(EGLNativeDisplayType display_id) {
+    if(g_num_libraries == 1) {
+        return g_libraries[0].eglGetDisplay(display_id);
+    }
+    egl_dispatch_table* library = choose_library();
+    t_last_library = library;
+    t_routing_error = EGL_SUCCESS;
+    EGLDisplay dpy = library->eglGetDisplay(display_id);
+    if(dpy != EGL_NO_DISPLAY && !remember_display(dpy, library)) {
+        t_routing_error = EGL_BAD_DISPLAY;
+        return EGL_NO_DISPLAY;
+    }
+    return dpy;
+}
+
+// Per-thread API state is kept by every library, so it is set on all of them.
+static EGLBoolean route_eglBindAPI(EGLenum api) {
+    EGLBoolean result = g_libraries[0].eglBindAPI(api);
+    for(unsigned int i = 1; i < g_num_libraries; i++) {
+        g_libraries[i].eglBindAPI(api);
+    }
+    t_last_library = &g_libraries[0];
+    return result;
+}
+
+static EGLBoolean route_eglReleaseThread(void) {
+    EGLBoolean result = g_libraries[0].eglReleaseThread();
+    for(unsigned int i = 1; i < g_num_libraries; i++) {
+        g_libraries[i].eglReleaseThread();
+    }
+    t_current_library = NULL;
+    t_last_library = &g_libraries[0];
+    return result;
+}
+
+static EGLContext route_eglCreateContext(EGLDisplay dpy, EGLConfig config, EGLContext share_context, const EGLint *attrib_list) {
+    egl_dispatch_table* library = dispatch_for_display(dpy);
+    EGLContext ctx = library->eglCreateContext(dpy, config, share_context, attrib_list);
+    if(ctx != EGL_NO_CONTEXT) {
+        atomic_fetch_add(&library->num_contexts, 1);
+    }
+    return ctx;
+}
+
+static EGLBoolean route_eglDestroyContext(EGLDisplay dpy, EGLContext ctx) {
+    egl_dispatch_table* library = dispatch_for_display(dpy);
+    EGLBoolean result = library->eglDestroyContext(dpy, ctx);
+    if(result == EGL_TRUE) {
+        atomic_fetch_sub(&library->num_contexts, 1);
+    }
+    return result;
+}
+
+static EGLBoolean route_eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx) {
+    egl_dispatch_table* library = dispatch_for_display(dpy);
+    // A thread has one current context across all libraries, so one
+    // current in another library is released first.
+    egl_dispatch_table* previous = t_current_library;
+    if(previous != NULL && previous != library) {
+        previous->eglMakeCurrent(previous->eglGetCurrentDisplay(), EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        t_current_library = NULL;
+    }
+    EGLBoolean result = library->eglMakeCurrent(dpy, draw, read, ctx);
+    if(result == EGL_TRUE && g_num_libraries > 1) {
+        t_current_library = ctx != EGL_NO_CONTEXT ? library : NULL;
+    }
+    return result;
+}
+
+// Extension functions returned by eglGetProcAddress with several
+// libraries. Each library has its own implementation of a function, so
+// the application gets a trampoline which picks one for each call: the
+// one of the library owning the first argument if that is a known
+// display, otherwise the one of the library of the thread's current
+// context. Arguments are forwarded as integers, which covers the EGL
+// extension functions (none take floating point arguments) with up to
+// ROUTED_PROC_ARGS arguments. This relies on the ABI passing integer and
+// pointer arguments alike in 64-bit slots, where unused ones are ignored:
+// it holds on the usual 64-bit ABIs, but not on 32-bit ones, where a
+// 64-bit argument (e.g. EGLTimeKHR) takes two slots. There, functions
+// which differ between libraries aren't routed. The platform display
+// functions are called through their own prototype, so are routed
+// everywhere.
+#define MAX_ROUTED_PROCS 32
+#define ROUTED_PROC_ARGS 8
+
+typedef uintptr_t (*routed_proc)(uintptr_t, uintptr_t, uintptr_t, uintptr_t,
+    uintptr_t, uintptr_t, uintptr_t, uintptr_t);
+
+typedef struct {
+    char* name;
+    routed_proc procs[MAX_EGL_LIBRARIES];
+} routed_proc_slot;
+
+static routed_proc_slot g_routed_procs[MAX_ROUTED_PROCS];
+static _Atomic unsigned int g_num_routed_procs = 0;
+static pthread_mutex_t g_routed_procs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uintptr_t call_routed_proc(unsigned int slot, uintptr_t a0, uintptr_t a1, uintptr_t a2,
+    uintptr_t a3, uintptr_t a4, uintptr_t a5, uintptr_t a6, uintptr_t a7) {
+    if(g_redundancy_enabled) {
+        redundancy_other_call();
+    }
+    egl_dispatch_table* library = find_display((EGLDisplay)a0);
+    if(library == NULL) {
+        library = dispatch_for_thread();
+    }
+    t_last_library = library;
+    routed_proc proc = g_routed_procs[slot].procs[library->index];
+    if(proc == NULL) {
+        // Not supported by the library this call belongs to.
+        t_routing_error = EGL_BAD_DISPLAY;
+        return 0;
+    }
+    t_routing_error = EGL_SUCCESS;
+    return proc(a0, a1, a2, a3, a4, a5, a6, a7);
+}
+
+#define ROUTED_PROC_TRAMPOLINE(N) \
+    static uintptr_t routed_proc_##N(uintptr_t a0, uintptr_t a1, uintptr_t a2, uintptr_t a3, \
+        uintptr_t a4, uintptr_t a5, uintptr_t a6, uintptr_t a7) { \
+        return call_routed_proc(N, a0, a1, a2, a3, a4, a5, a6, a7); \
+    }
+#define ROUTED_PROC_SLOTS(X) \
+    X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7) \
+    X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) \
+    X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23) \
+    X(24) X(25) X(26) X(27) X(28) X(29) X(30) X(31)
+
+ROUTED_PROC_SLOTS(ROUTED_PROC_TRAMPOLINE)
+
+#define ROUTED_PROC_ENTRY(N) routed_proc_##N,
+static const routed_proc g_routed_proc_trampolines[MAX_ROUTED_PROCS] = {
+    ROUTED_PROC_SLOTS(ROUTED_PROC_ENTRY)
+};
+#undef ROUTED_PROC_ENTRY
+#undef ROUTED_PROC_TRAMPOLINE
+#undef ROUTED_PROC_SLOTS
+
+// Displays created through eglGetPlatformDisplay(EXT) are spread over the
+// libraries like those of eglGetDisplay, and remembered for routing.
+static unsigned int g_get_platform_display_slot = MAX_ROUTED_PROCS;
+static unsigned int g_get_platform_display_ext_slot = MAX_ROUTED_PROCS;
+
+// eglGetPlatformDisplay and eglGetPlatformDisplayEXT, which only differ
+// in the type of attribute list.
+typedef EGLDisplay (*platform_display_proc)(EGLenum, void*, const void*);
+
+static EGLDisplay get_platform_display(unsigned int slot, EGLenum platform, void* native_display, const void* attrib_list) {
+    egl_dispatch_table* library = choose_library();
+    t_last_library = library;
+    routed_proc proc = g_routed_procs[slot].procs[library->index];
+    if(proc == NULL) {
+        t_routing_error = EGL_BAD_PARAMETER;
+        return EGL_NO_DISPLAY;
+    }
+    t_routing_error = EGL_SUCCESS;
+    EGLDisplay dpy = ((platform_display_proc)(__eglMustCastToProperFunctionPointerType)proc)(platform, native_display, attrib_list);
+    if(dpy != EGL_NO_DISPLAY && !remember_display(dpy, library)) {
+        t_routing_error = EGL_BAD_DISPLAY;
+        return EGL_NO_DISPLAY;
+    }
+    return dpy;
+}
+
+static EGLDisplay routed_eglGetPlatformDisplay(EGLenum platform, void* native_display, const EGLAttrib* attrib_list) {
+    return get_platform_display(g_get_platform_display_slot, platform, native_display, attrib_list);
+}
+
+static EGLDisplay routed_eglGetPlatformDisplayEXT(EGLenum platform, void* native_display, const EGLint* attrib_list) {
+    return get_platform_display(g_get_platform_display_ext_slot, platform, native_display, attrib_list);
+}
+
+static __eglMustCastToProperFunctionPointerType routed_proc_for_slot(unsigned int slot) {
+    if(slot == g_get_platform_display_slot) {
+        return (__eglMustCastToProperFunctionPointerType)routed_eglGetPlatformDisplay;
+    } else if(slot == g_get_platform_display_ext_slot) {
+        return (__eglMustCastToProperFunctionPointerType)routed_eglGetPlatformDisplayEXT;
+    }
+    return (__eglMustCastToProperFunctionPointerType)g_routed_proc_trampolines[slot];
+}
+
+static __eglMustCastToProperFunctionPointerType route_eglGetProcAddress(const char* proc_name) {
+    // Client API (e.g. GL) functions are not routed: they belong to the
+    // library of the current context.
+    if(g_num_libraries == 1 || proc_name == NULL || strncmp(proc_name, "egl", 3) != 0) {
+        return dispatch_for_thread()->eglGetProcAddress(proc_name);
+    }
+
+    unsigned int num_routed = atomic_load_explicit(&g_num_routed_procs, memory_order_acquire);
+    for(unsigned int i = 0; i < num_routed; i++) {
+        if(strcmp(g_routed_procs[i].name, proc_name) == 0) {
+            return routed_proc_for_slot(i);
+        }
+    }
+
+    routed_proc procs[MAX_EGL_LIBRARIES] = {NULL};
+    bool differ = false;
+    for(unsigned int i = 0; i < g_num_libraries; i++) {
+        procs[i] = (routed_proc)g_libraries[i].eglGetProcAddress(proc_name);
+        differ = differ || procs[i] != procs[0];
+    }
+    if(!differ) {
+        return (__eglMustCastToProperFunctionPointerType)procs[0];
+    }
+    bool platform_display = strcmp(proc_name, "eglGetPlatformDisplay") == 0 ||
+        strcmp(proc_name, "eglGetPlatformDisplayEXT") == 0;
+    if(sizeof(uintptr_t) < 8 && !platform_display) {
+        fprintf(stderr, "EGL extension functions can't be routed on this ABI, %s belongs to the current context's library\n", proc_name);
+        return (__eglMustCastToProperFunctionPointerType)procs[dispatch_for_thread()->index];
+    }
+
+    pthread_mutex_lock(&g_routed_procs_lock);
+    unsigned int slot = atomic_load(&g_num_routed_procs);
+    for(unsigned int i = 0; i < slot; i++) {
+        if(strcmp(g_routed_procs[i].name, proc_name) == 0) {
+            slot = i;
+            break;
+        }
+    }
+    __eglMustCastToProperFunctionPointerType result;
+    if(slot == MAX_ROUTED_PROCS) {
+        fprintf(stderr, "Too many routed EGL extension functions, %s belongs to the current context's library\n", proc_name);
+        result = dispatch_for_thread()->eglGetProcAddress(proc_name);
+    } else {
+        if(slot == atomic_load(&g_num_routed_procs)) {
+            g_routed_procs[slot].name = strdup(proc_name);
+            memcpy(g_routed_procs[slot].procs, procs, sizeof(procs));
+            if(strcmp(proc_name, "eglGetPlatformDisplay") == 0) {
+                g_get_platform_display_slot = slot;
+            } else if(strcmp(proc_name, "eglGetPlatformDisplayEXT") == 0) {
+                g_get_platform_display_ext_slot = slot;
+            }
+            atomic_store_explicit(&g_num_routed_procs, slot + 1, memory_order_release);
+        }
+        result = routed_proc_for_slot(slot);
+    }
+    pthread_mutex_unlock(&g_routed_procs_lock);
+    return result;
+}
+
+void egl_wrapper_set_display_policy(egl_wrapper_display_policy policy) {
+    g_display_policy = policy;
+}
+
+int egl_wrapper_display_library(EGLDisplay dpy) {
+    if(g_init_state != INITIALIZED) {
+        return -1;
+    }
+    return (int)lookup_display(dpy)->index;
+}
+
+static void display_policy_init_from_env(void) {
+    const char* policy = getenv("EGL_WRAPPER_DISPLAY_POLICY");
+    if(policy == NULL) {
+        return;
+    }
+    if(strcmp(policy, "round-robin") == 0) {
+        g_display_policy = EGL_WRAPPER_DISPLAY_POLICY_ROUND_ROBIN;
+    } else if(strcmp(policy, "least-contexts") == 0) {
+        g_display_policy = EGL_WRAPPER_DISPLAY_POLICY_LEAST_CONTEXTS;
+    } else if(strcmp(policy, "first") == 0) {
+        g_display_policy = EGL_WRAPPER_DISPLAY_POLICY_FIRST;
+    } else {
+        fprintf(stderr, "Unknown EGL_WRAPPER_DISPLAY_POLICY: %s\n", policy);
+    }
+}
+
 void egl_wrapper_initialize(const char* library_path_optional) {
     if(g_init_state == INITIALIZED) {
         return;
     }
 
     // Set the initializing flag to ensure thread safety
-    Bool got_lock = false;
+    bool got_lock = false;
     init_state expected = NOT_INITIALIZED;
     got_lock = atomic_compare_exchange_strong(
         &g_init_state, &expected, INITIALIZING);
@@ -121,537 +603,657 @@ void egl_wrapper_initialize(const char* library_path_optional) {
 
     char* maybe_manual_path = getenv("EGL_TO_WRAP");
 
-    const char* wrapped_egl_path = 
+    const char* wrapped_egl_paths = 
         library_path_optional != NULL ? library_path_optional :
         maybe_manual_path != NULL ? maybe_manual_path :
         "libEGL.so";
-    
-    printf("Wrapped EGL is: %s\n", wrapped_egl_path);
 
-    g_egl_handle = dlopen(wrapped_egl_path, RTLD_LAZY);
-
-    if(g_egl_handle == NULL) {
-        fprintf(stderr, "Failed to load wrapped EGL: %s\n", wrapped_egl_path);
-        exit(-1);
+    if(g_wrapped_lookup != NULL) {
+        // The library was already loaded by someone else (GLVND vendor mode).
+        printf("Wrapped EGL is: %s\n", g_wrapped_lookup_name);
+        if(!fill_dispatch_table(&g_libraries[0], g_wrapped_lookup, g_wrapped_lookup_ctx, g_wrapped_lookup_name)) {
+            exit(-1);
+        }
+        g_num_libraries = 1;
+    } else {
+        // Multiple libraries may be given, separated by ':'.
+        char* paths = strdup(wrapped_egl_paths);
+        char* save = NULL;
+        for(char* path = strtok_r(paths, ":", &save); path != NULL; path = strtok_r(NULL, ":", &save)) {
+            if(g_num_libraries == MAX_EGL_LIBRARIES) {
+                fprintf(stderr, "Too many wrapped EGL libraries, ignoring %s\n", path);
+                continue;
+            }
+            printf("Wrapped EGL is: %s\n", path);
+            if(!load_library(&g_libraries[g_num_libraries], path)) {
+                exit(-1);
+            }
+            g_num_libraries++;
+        }
+        free(paths);
     }
 
-    g_eglGetError = dlsym(g_egl_handle, "eglGetError"  );
-    g_eglGetDisplay = dlsym(g_egl_handle, "eglGetDisplay"  );
-    g_eglInitialize = dlsym(g_egl_handle, "eglInitialize" );
-    g_eglTerminate = dlsym(g_egl_handle, "eglTerminate" );
-    g_eglQueryString = dlsym(g_egl_handle, "eglQueryString" );
-    g_eglGetConfigs = dlsym(g_egl_handle, "eglGetConfigs" );
-    g_eglChooseConfig = dlsym(g_egl_handle, "eglChooseConfig" );
-    g_eglGetConfigAttrib = dlsym(g_egl_handle, "eglGetConfigAttrib" );
-    g_eglCreateWindowSurface = dlsym(g_egl_handle, "eglCreateWindowSurface" );
-    g_eglCreatePbufferSurface = dlsym(g_egl_handle, "eglCreatePbufferSurface" );
-    g_eglCreatePixmapSurface = dlsym(g_egl_handle, "eglCreatePixmapSurface" );
-    g_eglDestroySurface = dlsym(g_egl_handle, "eglDestroySurface" );
-    g_eglQuerySurface = dlsym(g_egl_handle, "eglQuerySurface" );
-    g_eglBindAPI = dlsym(g_egl_handle, "eglBindAPI" );
-    g_eglQueryAPI = dlsym(g_egl_handle, "eglQueryAPI" );
-    g_eglWaitClient = dlsym(g_egl_handle, "eglWaitClient" );
-    g_eglReleaseThread = dlsym(g_egl_handle, "eglReleaseThread" );
-    g_eglCreatePbufferFromClientBuffer = dlsym(g_egl_handle, "eglCreatePbufferFromClientBuffer" );
-    g_eglSurfaceAttrib = dlsym(g_egl_handle, "eglSurfaceAttrib" );
-    g_eglBindTexImage = dlsym(g_egl_handle, "eglBindTexImage" );
-    g_eglReleaseTexImage = dlsym(g_egl_handle, "eglReleaseTexImage" );
-    g_eglSwapInterval = dlsym(g_egl_handle, "eglSwapInterval" );
-    g_eglCreateContext = dlsym(g_egl_handle, "eglCreateContext" );
-    g_eglDestroyContext = dlsym(g_egl_handle, "eglDestroyContext" );
-    g_eglMakeCurrent = dlsym(g_egl_handle, "eglMakeCurrent" );
-    g_eglGetCurrentContext = dlsym(g_egl_handle, "eglGetCurrentContext" );
-    g_eglGetCurrentSurface = dlsym(g_egl_handle, "eglGetCurrentSurface" );
-    g_eglGetCurrentDisplay = dlsym(g_egl_handle, "eglGetCurrentDisplay" );
-    g_eglQueryContext = dlsym(g_egl_handle, "eglQueryContext" );
-    g_eglWaitGL = dlsym(g_egl_handle, "eglWaitGL" );
-    g_eglWaitNative = dlsym(g_egl_handle, "eglWaitNative" );
-    g_eglSwapBuffers = dlsym(g_egl_handle, "eglSwapBuffers" );
-    g_eglCopyBuffers = dlsym(g_egl_handle, "eglCopyBuffers" );
-    g_eglGetProcAddress = dlsym(g_egl_handle, "eglGetProcAddress");
-
-    if(g_eglGetError == NULL ||
-        g_eglGetDisplay == NULL ||
-        g_eglInitialize == NULL ||
-        g_eglTerminate == NULL ||
-        g_eglQueryString == NULL ||
-        g_eglGetConfigs == NULL ||
-        g_eglChooseConfig == NULL ||
-        g_eglGetConfigAttrib == NULL ||
-        g_eglCreateWindowSurface == NULL ||
-        g_eglCreatePbufferSurface == NULL ||
-        g_eglCreatePixmapSurface == NULL ||
-        g_eglDestroySurface == NULL ||
-        g_eglQuerySurface == NULL ||
-        g_eglBindAPI == NULL ||
-        g_eglQueryAPI == NULL ||
-        g_eglWaitClient == NULL ||
-        g_eglReleaseThread == NULL ||
-        g_eglCreatePbufferFromClientBuffer == NULL ||
-        g_eglSurfaceAttrib == NULL ||
-        g_eglBindTexImage == NULL ||
-        g_eglReleaseTexImage == NULL ||
-        g_eglSwapInterval == NULL ||
-        g_eglCreateContext == NULL ||
-        g_eglDestroyContext == NULL ||
-        g_eglMakeCurrent == NULL ||
-        g_eglGetCurrentContext == NULL ||
-        g_eglGetCurrentSurface == NULL ||
-        g_eglGetCurrentDisplay == NULL ||
-        g_eglQueryContext == NULL ||
-        g_eglWaitGL == NULL ||
-        g_eglWaitNative == NULL ||
-        g_eglSwapBuffers == NULL ||
-        g_eglCopyBuffers == NULL ||
-        g_eglGetProcAddress == NULL
-    ) {
-        fprintf(stderr, "Failed to load all EGL API functions\n");
+    if(g_num_libraries == 0) {
+        fprintf(stderr, "No wrapped EGL given\n");
         exit(-1);
     }
 
+    display_policy_init_from_env();
+    decimation_init_from_env();
+    fences_init_from_env();
+    render_threads_init_from_env();
+    redundancy_init_from_env();
+    injection_init_from_env();
+
     g_init_state = INITIALIZED;
+
+    // Plugins may call EGL functions while being loaded.
+    plugins_init_from_env();
 }
 
 EGLint bare_eglGetError(void) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetError);
-    return g_eglGetError();
+    CHECK_INIT(eglGetError);
+    return route_eglGetError();
 }
 
 EGLDisplay bare_eglGetDisplay(EGLNativeDisplayType display_id) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetDisplay);
-    return g_eglGetDisplay(display_id);
+    CHECK_INIT(eglGetDisplay);
+    return route_eglGetDisplay(display_id);
 }
 
 EGLBoolean bare_eglInitialize(EGLDisplay dpy, EGLint *major, EGLint *minor) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglInitialize);
-    return g_eglInitialize(dpy, major, minor);
+    CHECK_INIT(eglInitialize);
+    return dispatch_for_display(dpy)->eglInitialize(dpy, major, minor);
 }
 
 EGLBoolean bare_eglTerminate(EGLDisplay dpy) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglTerminate);
-    return g_eglTerminate(dpy);
+    CHECK_INIT(eglTerminate);
+    return dispatch_for_display(dpy)->eglTerminate(dpy);
 }
 
 const char * bare_eglQueryString(EGLDisplay dpy, EGLint name) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglQueryString);
-    return g_eglQueryString(dpy, name);
+    CHECK_INIT(eglQueryString);
+    return dispatch_for_display(dpy)->eglQueryString(dpy, name);
 }
 
 EGLBoolean bare_eglGetConfigs(EGLDisplay dpy, EGLConfig *configs, EGLint config_size, EGLint *num_config) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetConfigs);
-    return g_eglGetConfigs(dpy, configs, config_size, num_config);
+    CHECK_INIT(eglGetConfigs);
+    return dispatch_for_display(dpy)->eglGetConfigs(dpy, configs, config_size, num_config);
 }
 
 EGLBoolean bare_eglChooseConfig(EGLDisplay dpy, const EGLint *attrib_list, EGLConfig *configs, EGLint config_size, EGLint *num_config) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglChooseConfig);
-    return g_eglChooseConfig(dpy, attrib_list, configs, config_size, num_config);
+    CHECK_INIT(eglChooseConfig);
+    return dispatch_for_display(dpy)->eglChooseConfig(dpy, attrib_list, configs, config_size, num_config);
 }
 
 EGLBoolean bare_eglGetConfigAttrib(EGLDisplay dpy, EGLConfig config, EGLint attribute, EGLint *value) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetConfigAttrib);
-    return g_eglGetConfigAttrib(dpy, config, attribute, value);
+    CHECK_INIT(eglGetConfigAttrib);
+    return dispatch_for_display(dpy)->eglGetConfigAttrib(dpy, config, attribute, value);
 }
 
 EGLSurface bare_eglCreateWindowSurface(EGLDisplay dpy, EGLConfig config, EGLNativeWindowType win, const EGLint *attrib_list) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglCreateWindowSurface);
-    return g_eglCreateWindowSurface(dpy, config, win, attrib_list);
+    CHECK_INIT(eglCreateWindowSurface);
+    return dispatch_for_display(dpy)->eglCreateWindowSurface(dpy, config, win, attrib_list);
 }
 
 EGLSurface bare_eglCreatePbufferSurface(EGLDisplay dpy, EGLConfig config, const EGLint *attrib_list) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglCreatePbufferSurface);
-    return g_eglCreatePbufferSurface(dpy, config, attrib_list);
+    CHECK_INIT(eglCreatePbufferSurface);
+    return dispatch_for_display(dpy)->eglCreatePbufferSurface(dpy, config, attrib_list);
 }
 
 EGLSurface bare_eglCreatePixmapSurface(EGLDisplay dpy, EGLConfig config, EGLNativePixmapType pixmap, const EGLint *attrib_list) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglCreatePixmapSurface);
-    return g_eglCreatePixmapSurface(dpy, config, pixmap, attrib_list);
+    CHECK_INIT(eglCreatePixmapSurface);
+    return dispatch_for_display(dpy)->eglCreatePixmapSurface(dpy, config, pixmap, attrib_list);
 }
 
 EGLBoolean bare_eglDestroySurface(EGLDisplay dpy, EGLSurface surface) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglDestroySurface);
-    return g_eglDestroySurface(dpy, surface);
+    CHECK_INIT(eglDestroySurface);
+    return dispatch_for_display(dpy)->eglDestroySurface(dpy, surface);
 }
 
 EGLBoolean bare_eglQuerySurface(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint *value) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglQuerySurface);
-    return g_eglQuerySurface(dpy, surface, attribute, value);
+    CHECK_INIT(eglQuerySurface);
+    return dispatch_for_display(dpy)->eglQuerySurface(dpy, surface, attribute, value);
 }
 
 EGLBoolean bare_eglBindAPI(EGLenum api) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglBindAPI);
-    return g_eglBindAPI(api);
+    CHECK_INIT(eglBindAPI);
+    return route_eglBindAPI(api);
 }
 
 EGLenum bare_eglQueryAPI(void) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglQueryAPI);
-    return g_eglQueryAPI();
+    CHECK_INIT(eglQueryAPI);
+    return dispatch_for_thread()->eglQueryAPI();
 }
 
 EGLBoolean bare_eglWaitClient(void) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglWaitClient);
-    return g_eglWaitClient();
+    CHECK_INIT(eglWaitClient);
+    return dispatch_for_thread()->eglWaitClient();
 }
 
 EGLBoolean bare_eglReleaseThread(void) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglReleaseThread);
-    return g_eglReleaseThread();
+    CHECK_INIT(eglReleaseThread);
+    EGLBoolean result = route_eglReleaseThread();
+    if(g_scoped_hooks_used && result == EGL_TRUE) {
+        scoped_hooks_after_make_current(EGL_NO_DISPLAY, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+    return result;
 }
 
 EGLSurface bare_eglCreatePbufferFromClientBuffer(EGLDisplay dpy, EGLenum buftype, EGLClientBuffer buffer, EGLConfig config, const EGLint *attrib_list) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglCreatePbufferFromClientBuffer);
-    return g_eglCreatePbufferFromClientBuffer(dpy, buftype, buffer, config, attrib_list);
+    CHECK_INIT(eglCreatePbufferFromClientBuffer);
+    return dispatch_for_display(dpy)->eglCreatePbufferFromClientBuffer(dpy, buftype, buffer, config, attrib_list);
 }
 
 EGLBoolean bare_eglSurfaceAttrib(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint value) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglSurfaceAttrib);
-    return g_eglSurfaceAttrib(dpy, surface, attribute, value);
+    CHECK_INIT(eglSurfaceAttrib);
+    return dispatch_for_display(dpy)->eglSurfaceAttrib(dpy, surface, attribute, value);
 }
 
 EGLBoolean bare_eglBindTexImage(EGLDisplay dpy, EGLSurface surface, EGLint buffer) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglBindTexImage);
-    return g_eglBindTexImage(dpy, surface, buffer);
+    CHECK_INIT(eglBindTexImage);
+    return dispatch_for_display(dpy)->eglBindTexImage(dpy, surface, buffer);
 }
 
 EGLBoolean bare_eglReleaseTexImage(EGLDisplay dpy, EGLSurface surface, EGLint buffer) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglReleaseTexImage);
-    return g_eglReleaseTexImage(dpy, surface, buffer);
+    CHECK_INIT(eglReleaseTexImage);
+    return dispatch_for_display(dpy)->eglReleaseTexImage(dpy, surface, buffer);
 }
 
 EGLBoolean bare_eglSwapInterval(EGLDisplay dpy, EGLint interval) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglSwapInterval);
-    return g_eglSwapInterval(dpy, interval);
+    CHECK_INIT(eglSwapInterval);
+    return dispatch_for_display(dpy)->eglSwapInterval(dpy, interval);
 }
 
 EGLContext bare_eglCreateContext(EGLDisplay dpy, EGLConfig config, EGLContext share_context, const EGLint *attrib_list) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglCreateContext);
-    return g_eglCreateContext(dpy, config, share_context, attrib_list);
+    CHECK_INIT(eglCreateContext);
+    return route_eglCreateContext(dpy, config, share_context, attrib_list);
 }
 
 EGLBoolean bare_eglDestroyContext(EGLDisplay dpy, EGLContext ctx) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglDestroyContext);
-    return g_eglDestroyContext(dpy, ctx);
+    CHECK_INIT(eglDestroyContext);
+    return route_eglDestroyContext(dpy, ctx);
 }
 
 EGLBoolean bare_eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglMakeCurrent);
-    return g_eglMakeCurrent(dpy, draw, read, ctx);
+    CHECK_INIT(eglMakeCurrent);
+    return route_eglMakeCurrent(dpy, draw, read, ctx);
 }
 
 EGLContext bare_eglGetCurrentContext(void) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetCurrentContext);
-    return g_eglGetCurrentContext();
+    CHECK_INIT(eglGetCurrentContext);
+    return dispatch_for_thread()->eglGetCurrentContext();
 }
 
 EGLSurface bare_eglGetCurrentSurface(EGLint readdraw) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetCurrentSurface);
-    return g_eglGetCurrentSurface(readdraw);
+    CHECK_INIT(eglGetCurrentSurface);
+    return dispatch_for_thread()->eglGetCurrentSurface(readdraw);
 }
 
 EGLDisplay bare_eglGetCurrentDisplay(void) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetCurrentDisplay);
-    return g_eglGetCurrentDisplay();
+    CHECK_INIT(eglGetCurrentDisplay);
+    return dispatch_for_thread()->eglGetCurrentDisplay();
 }
 
 EGLBoolean bare_eglQueryContext(EGLDisplay dpy, EGLContext ctx, EGLint attribute, EGLint *value) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglQueryContext);
-    return g_eglQueryContext(dpy, ctx, attribute, value);
+    CHECK_INIT(eglQueryContext);
+    return dispatch_for_display(dpy)->eglQueryContext(dpy, ctx, attribute, value);
 }
 
 EGLBoolean bare_eglWaitGL(void) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglWaitGL);
-    return g_eglWaitGL();
+    CHECK_INIT(eglWaitGL);
+    return dispatch_for_thread()->eglWaitGL();
 }
 
 EGLBoolean bare_eglWaitNative(EGLint engine) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglWaitNative);
-    return g_eglWaitNative(engine);
+    CHECK_INIT(eglWaitNative);
+    return dispatch_for_thread()->eglWaitNative(engine);
 }
 
 EGLBoolean bare_eglSwapBuffers(EGLDisplay dpy, EGLSurface surface) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglSwapBuffers);
-    return g_eglSwapBuffers(dpy, surface);
+    CHECK_INIT(eglSwapBuffers);
+    return dispatch_for_display(dpy)->eglSwapBuffers(dpy, surface);
 }
 
 EGLBoolean bare_eglCopyBuffers(EGLDisplay dpy, EGLSurface surface, EGLNativePixmapType target) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglCopyBuffers);
-    return g_eglCopyBuffers(dpy, surface, target);
+    CHECK_INIT(eglCopyBuffers);
+    return dispatch_for_display(dpy)->eglCopyBuffers(dpy, surface, target);
 }
 
 __eglMustCastToProperFunctionPointerType bare_eglGetProcAddress(const char* proc_name) {
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetProcAddress);
-    return g_eglGetProcAddress(proc_name);
+    CHECK_INIT(eglGetProcAddress);
+    return route_eglGetProcAddress(proc_name);
 }
 
 EGLint eglGetError(void) {
-    if(g_callback_eglGetError != NULL) {
-        return g_callback_eglGetError();
+    if(g_injection_enabled) {
+        EGLint injected = injection_get_error();
+        if(injected != EGL_SUCCESS) {
+            return injected;
+        }
+    }
+    uint64_t start = g_redundancy_enabled ? egl_wrapper_now_ns() : 0;
+    EGLint result;
+    // Asking the driver for the binding would clear the error to return.
+    RESOLVE_HOOK_QUERYING(eglGetError, false);
+    if(hook != NULL) {
+        result = hook();
+    } else {
+        CHECK_INIT(eglGetError);
+        result = route_eglGetError();
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetError);
-    return g_eglGetError();
+    if(g_redundancy_enabled) {
+        redundancy_get_error(__builtin_return_address(0), start, result);
+    }
+    return result;
 }
 
 EGLDisplay eglGetDisplay(EGLNativeDisplayType display_id) {
-    if(g_callback_eglGetDisplay != NULL) {
-        return g_callback_eglGetDisplay(display_id);
+    INJECT(eglGetDisplay, EGL_NO_DISPLAY);
+    RESOLVE_HOOK(eglGetDisplay);
+    if(hook != NULL) {
+        return hook(display_id);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetDisplay);
-    return g_eglGetDisplay(display_id);
+    CHECK_INIT(eglGetDisplay);
+    return route_eglGetDisplay(display_id);
 }
 
 EGLBoolean eglInitialize(EGLDisplay dpy, EGLint *major, EGLint *minor) {
-    if(g_callback_eglInitialize != NULL) {
-        return g_callback_eglInitialize(dpy, major, minor);
+    INJECT(eglInitialize, EGL_FALSE);
+    RESOLVE_HOOK(eglInitialize);
+    if(hook != NULL) {
+        return hook(dpy, major, minor);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglInitialize);
-    return g_eglInitialize(dpy, major, minor);
+    CHECK_INIT(eglInitialize);
+    return dispatch_for_display(dpy)->eglInitialize(dpy, major, minor);
 }
 
 EGLBoolean eglTerminate(EGLDisplay dpy) {
-    if(g_callback_eglTerminate != NULL) {
-        return g_callback_eglTerminate(dpy);
+    INJECT(eglTerminate, EGL_FALSE);
+    RESOLVE_HOOK(eglTerminate);
+    if(hook != NULL) {
+        return hook(dpy);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglTerminate);
-    return g_eglTerminate(dpy);
+    CHECK_INIT(eglTerminate);
+    return dispatch_for_display(dpy)->eglTerminate(dpy);
 }
 
 const char * eglQueryString(EGLDisplay dpy, EGLint name) {
-    if(g_callback_eglQueryString != NULL) {
-        return g_callback_eglQueryString(dpy, name);
+    INJECT(eglQueryString, NULL);
+    RESOLVE_HOOK(eglQueryString);
+    if(hook != NULL) {
+        return hook(dpy, name);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglQueryString);
-    return g_eglQueryString(dpy, name);
+    CHECK_INIT(eglQueryString);
+    return dispatch_for_display(dpy)->eglQueryString(dpy, name);
 }
 
 EGLBoolean eglGetConfigs(EGLDisplay dpy, EGLConfig *configs, EGLint config_size, EGLint *num_config) {
-    if(g_callback_eglGetConfigs != NULL) {
-        return g_callback_eglGetConfigs(dpy, configs, config_size, num_config);
+    INJECT(eglGetConfigs, EGL_FALSE);
+    RESOLVE_HOOK(eglGetConfigs);
+    if(hook != NULL) {
+        return hook(dpy, configs, config_size, num_config);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetConfigs);
-    return g_eglGetConfigs(dpy, configs, config_size, num_config);
+    CHECK_INIT(eglGetConfigs);
+    return dispatch_for_display(dpy)->eglGetConfigs(dpy, configs, config_size, num_config);
 }
 
 EGLBoolean eglChooseConfig(EGLDisplay dpy, const EGLint *attrib_list, EGLConfig *configs, EGLint config_size, EGLint *num_config) {
-    if(g_callback_eglChooseConfig != NULL) {
-        return g_callback_eglChooseConfig(dpy, attrib_list, configs, config_size, num_config);
+    INJECT(eglChooseConfig, EGL_FALSE);
+    RESOLVE_HOOK(eglChooseConfig);
+    if(hook != NULL) {
+        return hook(dpy, attrib_list, configs, config_size, num_config);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglChooseConfig);
-    return g_eglChooseConfig(dpy, attrib_list, configs, config_size, num_config);
+    CHECK_INIT(eglChooseConfig);
+    return dispatch_for_display(dpy)->eglChooseConfig(dpy, attrib_list, configs, config_size, num_config);
 }
 
 EGLBoolean eglGetConfigAttrib(EGLDisplay dpy, EGLConfig config, EGLint attribute, EGLint *value) {
-    if(g_callback_eglGetConfigAttrib != NULL) {
-        return g_callback_eglGetConfigAttrib(dpy, config, attribute, value);
+    INJECT(eglGetConfigAttrib, EGL_FALSE);
+    uint64_t start = g_redundancy_enabled ? egl_wrapper_now_ns() : 0;
+    EGLBoolean result;
+    RESOLVE_HOOK(eglGetConfigAttrib);
+    if(hook != NULL) {
+        result = hook(dpy, config, attribute, value);
+    } else {
+        CHECK_INIT(eglGetConfigAttrib);
+        result = dispatch_for_display(dpy)->eglGetConfigAttrib(dpy, config, attribute, value);
+    }
+    if(g_redundancy_enabled) {
+        redundancy_get_config_attrib(__builtin_return_address(0), start, dpy, config, attribute, value, result);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetConfigAttrib);
-    return g_eglGetConfigAttrib(dpy, config, attribute, value);
+    return result;
 }
 
 EGLSurface eglCreateWindowSurface(EGLDisplay dpy, EGLConfig config, EGLNativeWindowType win, const EGLint *attrib_list) {
-    if(g_callback_eglCreateWindowSurface != NULL) {
-        return g_callback_eglCreateWindowSurface(dpy, config, win, attrib_list);
+    INJECT(eglCreateWindowSurface, EGL_NO_SURFACE);
+    RESOLVE_HOOK(eglCreateWindowSurface);
+    if(hook != NULL) {
+        return hook(dpy, config, win, attrib_list);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglCreateWindowSurface);
-    return g_eglCreateWindowSurface(dpy, config, win, attrib_list);
+    CHECK_INIT(eglCreateWindowSurface);
+    return dispatch_for_display(dpy)->eglCreateWindowSurface(dpy, config, win, attrib_list);
 }
 
 EGLSurface eglCreatePbufferSurface(EGLDisplay dpy, EGLConfig config, const EGLint *attrib_list) {
-    if(g_callback_eglCreatePbufferSurface != NULL) {
-        return g_callback_eglCreatePbufferSurface(dpy, config, attrib_list);
+    INJECT(eglCreatePbufferSurface, EGL_NO_SURFACE);
+    RESOLVE_HOOK(eglCreatePbufferSurface);
+    if(hook != NULL) {
+        return hook(dpy, config, attrib_list);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglCreatePbufferSurface);
-    return g_eglCreatePbufferSurface(dpy, config, attrib_list);
+    CHECK_INIT(eglCreatePbufferSurface);
+    return dispatch_for_display(dpy)->eglCreatePbufferSurface(dpy, config, attrib_list);
 }
 
 EGLSurface eglCreatePixmapSurface(EGLDisplay dpy, EGLConfig config, EGLNativePixmapType pixmap, const EGLint *attrib_list) {
-    if(g_callback_eglCreatePixmapSurface != NULL) {
-        return g_callback_eglCreatePixmapSurface(dpy, config, pixmap, attrib_list);
+    INJECT(eglCreatePixmapSurface, EGL_NO_SURFACE);
+    RESOLVE_HOOK(eglCreatePixmapSurface);
+    if(hook != NULL) {
+        return hook(dpy, config, pixmap, attrib_list);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglCreatePixmapSurface);
-    return g_eglCreatePixmapSurface(dpy, config, pixmap, attrib_list);
+    CHECK_INIT(eglCreatePixmapSurface);
+    return dispatch_for_display(dpy)->eglCreatePixmapSurface(dpy, config, pixmap, attrib_list);
 }
 
 EGLBoolean eglDestroySurface(EGLDisplay dpy, EGLSurface surface) {
-    if(g_callback_eglDestroySurface != NULL) {
-        return g_callback_eglDestroySurface(dpy, surface);
+    INJECT(eglDestroySurface, EGL_FALSE);
+    if(g_decimation_enabled) {
+        decimation_forget_surface(surface);
+    }
+    // Fences queued before the limiter or GPU timing were disabled still
+    // hold a queue, so this is done either way.
+    fences_forget_surface(surface);
+    RESOLVE_HOOK(eglDestroySurface);
+    if(hook != NULL) {
+        return hook(dpy, surface);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglDestroySurface);
-    return g_eglDestroySurface(dpy, surface);
+    CHECK_INIT(eglDestroySurface);
+    return dispatch_for_display(dpy)->eglDestroySurface(dpy, surface);
 }
 
 EGLBoolean eglQuerySurface(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint *value) {
-    if(g_callback_eglQuerySurface != NULL) {
-        return g_callback_eglQuerySurface(dpy, surface, attribute, value);
+    INJECT(eglQuerySurface, EGL_FALSE);
+    uint64_t start = g_redundancy_enabled ? egl_wrapper_now_ns() : 0;
+    EGLBoolean result;
+    RESOLVE_HOOK(eglQuerySurface);
+    if(hook != NULL) {
+        result = hook(dpy, surface, attribute, value);
+    } else {
+        CHECK_INIT(eglQuerySurface);
+        result = dispatch_for_display(dpy)->eglQuerySurface(dpy, surface, attribute, value);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglQuerySurface);
-    return g_eglQuerySurface(dpy, surface, attribute, value);
+    if(g_redundancy_enabled) {
+        redundancy_query_surface(__builtin_return_address(0), start, dpy, surface, attribute, value, result);
+    }
+    return result;
 }
 
 EGLBoolean eglBindAPI(EGLenum api) {
-    if(g_callback_eglBindAPI != NULL) {
-        return g_callback_eglBindAPI(api);
+    INJECT(eglBindAPI, EGL_FALSE);
+    RESOLVE_HOOK(eglBindAPI);
+    if(hook != NULL) {
+        return hook(api);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglBindAPI);
-    return g_eglBindAPI(api);
+    CHECK_INIT(eglBindAPI);
+    return route_eglBindAPI(api);
 }
 
 EGLenum eglQueryAPI(void) {
-    if(g_callback_eglQueryAPI != NULL) {
-        return g_callback_eglQueryAPI();
+    INJECT(eglQueryAPI, EGL_NONE);
+    RESOLVE_HOOK(eglQueryAPI);
+    if(hook != NULL) {
+        return hook();
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglQueryAPI);
-    return g_eglQueryAPI();
+    CHECK_INIT(eglQueryAPI);
+    return dispatch_for_thread()->eglQueryAPI();
 }
 
 EGLBoolean eglWaitClient(void) {
-    if(g_callback_eglWaitClient != NULL) {
-        return g_callback_eglWaitClient();
+    INJECT(eglWaitClient, EGL_FALSE);
+    RESOLVE_HOOK(eglWaitClient);
+    if(hook != NULL) {
+        return hook();
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglWaitClient);
-    return g_eglWaitClient();
+    CHECK_INIT(eglWaitClient);
+    return dispatch_for_thread()->eglWaitClient();
 }
 
 EGLBoolean eglReleaseThread(void) {
-    if(g_callback_eglReleaseThread != NULL) {
-        return g_callback_eglReleaseThread();
+    INJECT(eglReleaseThread, EGL_FALSE);
+    RESOLVE_HOOK(eglReleaseThread);
+    if(hook != NULL) {
+        return hook();
+    }
+    CHECK_INIT(eglReleaseThread);
+    EGLBoolean result = route_eglReleaseThread();
+    if(g_scoped_hooks_used && result == EGL_TRUE) {
+        scoped_hooks_after_make_current(EGL_NO_DISPLAY, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglReleaseThread);
-    return g_eglReleaseThread();
+    return result;
 }
 
 EGLSurface eglCreatePbufferFromClientBuffer(EGLDisplay dpy, EGLenum buftype, EGLClientBuffer buffer, EGLConfig config, const EGLint *attrib_list) {
-    if(g_callback_eglCreatePbufferFromClientBuffer != NULL) {
-        return g_callback_eglCreatePbufferFromClientBuffer(dpy, buftype, buffer, config, attrib_list);
+    INJECT(eglCreatePbufferFromClientBuffer, EGL_NO_SURFACE);
+    RESOLVE_HOOK(eglCreatePbufferFromClientBuffer);
+    if(hook != NULL) {
+        return hook(dpy, buftype, buffer, config, attrib_list);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglCreatePbufferFromClientBuffer);
-    return g_eglCreatePbufferFromClientBuffer(dpy, buftype, buffer, config, attrib_list);
+    CHECK_INIT(eglCreatePbufferFromClientBuffer);
+    return dispatch_for_display(dpy)->eglCreatePbufferFromClientBuffer(dpy, buftype, buffer, config, attrib_list);
 }
 
 EGLBoolean eglSurfaceAttrib(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint value) {
-    if(g_callback_eglSurfaceAttrib != NULL) {
-        return g_callback_eglSurfaceAttrib(dpy, surface, attribute, value);
+    INJECT(eglSurfaceAttrib, EGL_FALSE);
+    RESOLVE_HOOK(eglSurfaceAttrib);
+    if(hook != NULL) {
+        return hook(dpy, surface, attribute, value);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglSurfaceAttrib);
-    return g_eglSurfaceAttrib(dpy, surface, attribute, value);
+    CHECK_INIT(eglSurfaceAttrib);
+    return dispatch_for_display(dpy)->eglSurfaceAttrib(dpy, surface, attribute, value);
 }
 
 EGLBoolean eglBindTexImage(EGLDisplay dpy, EGLSurface surface, EGLint buffer) {
-    if(g_callback_eglBindTexImage != NULL) {
-        return g_callback_eglBindTexImage(dpy, surface, buffer);
+    INJECT(eglBindTexImage, EGL_FALSE);
+    RESOLVE_HOOK(eglBindTexImage);
+    if(hook != NULL) {
+        return hook(dpy, surface, buffer);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglBindTexImage);
-    return g_eglBindTexImage(dpy, surface, buffer);
+    CHECK_INIT(eglBindTexImage);
+    return dispatch_for_display(dpy)->eglBindTexImage(dpy, surface, buffer);
 }
 
 EGLBoolean eglReleaseTexImage(EGLDisplay dpy, EGLSurface surface, EGLint buffer) {
-    if(g_callback_eglReleaseTexImage != NULL) {
-        return g_callback_eglReleaseTexImage(dpy, surface, buffer);
+    INJECT(eglReleaseTexImage, EGL_FALSE);
+    RESOLVE_HOOK(eglReleaseTexImage);
+    if(hook != NULL) {
+        return hook(dpy, surface, buffer);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglReleaseTexImage);
-    return g_eglReleaseTexImage(dpy, surface, buffer);
+    CHECK_INIT(eglReleaseTexImage);
+    return dispatch_for_display(dpy)->eglReleaseTexImage(dpy, surface, buffer);
 }
 
 EGLBoolean eglSwapInterval(EGLDisplay dpy, EGLint interval) {
-    if(g_callback_eglSwapInterval != NULL) {
-        return g_callback_eglSwapInterval(dpy, interval);
+    INJECT(eglSwapInterval, EGL_FALSE);
+    uint64_t start = g_redundancy_enabled ? egl_wrapper_now_ns() : 0;
+    EGLBoolean result;
+    RESOLVE_HOOK(eglSwapInterval);
+    if(hook != NULL) {
+        result = hook(dpy, interval);
+    } else {
+        CHECK_INIT(eglSwapInterval);
+        result = dispatch_for_display(dpy)->eglSwapInterval(dpy, interval);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglSwapInterval);
-    return g_eglSwapInterval(dpy, interval);
+    if(g_redundancy_enabled) {
+        redundancy_swap_interval(__builtin_return_address(0), start, dpy, interval, result);
+    }
+    return result;
 }
 
 EGLContext eglCreateContext(EGLDisplay dpy, EGLConfig config, EGLContext share_context, const EGLint *attrib_list) {
-    if(g_callback_eglCreateContext != NULL) {
-        return g_callback_eglCreateContext(dpy, config, share_context, attrib_list);
+    INJECT(eglCreateContext, EGL_NO_CONTEXT);
+    RESOLVE_HOOK(eglCreateContext);
+    if(hook != NULL) {
+        return hook(dpy, config, share_context, attrib_list);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglCreateContext);
-    return g_eglCreateContext(dpy, config, share_context, attrib_list);
+    CHECK_INIT(eglCreateContext);
+    return route_eglCreateContext(dpy, config, share_context, attrib_list);
 }
 
 EGLBoolean eglDestroyContext(EGLDisplay dpy, EGLContext ctx) {
-    if(g_callback_eglDestroyContext != NULL) {
-        return g_callback_eglDestroyContext(dpy, ctx);
+    INJECT(eglDestroyContext, EGL_FALSE);
+    RESOLVE_HOOK(eglDestroyContext);
+    if(hook != NULL) {
+        return hook(dpy, ctx);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglDestroyContext);
-    return g_eglDestroyContext(dpy, ctx);
+    CHECK_INIT(eglDestroyContext);
+    return route_eglDestroyContext(dpy, ctx);
 }
 
 EGLBoolean eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx) {
-    if(g_callback_eglMakeCurrent != NULL) {
-        return g_callback_eglMakeCurrent(dpy, draw, read, ctx);
+    INJECT(eglMakeCurrent, EGL_FALSE);
+    uint64_t start = g_redundancy_enabled ? egl_wrapper_now_ns() : 0;
+    EGLBoolean result;
+    RESOLVE_HOOK(eglMakeCurrent);
+    if(hook != NULL) {
+        result = hook(dpy, draw, read, ctx);
+    } else {
+        CHECK_INIT(eglMakeCurrent);
+        result = route_eglMakeCurrent(dpy, draw, read, ctx);
+    }
+    if(g_render_threads_enabled && result == EGL_TRUE && ctx != EGL_NO_CONTEXT) {
+        render_threads_after_make_current();
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglMakeCurrent);
-    return g_eglMakeCurrent(dpy, draw, read, ctx);
+    if(g_scoped_hooks_used && result == EGL_TRUE) {
+        scoped_hooks_after_make_current(dpy, draw, read, ctx);
+    }
+    if(g_redundancy_enabled) {
+        redundancy_make_current(__builtin_return_address(0), start, dpy, draw, read, ctx, result);
+    }
+    return result;
 }
 
 EGLContext eglGetCurrentContext(void) {
-    if(g_callback_eglGetCurrentContext != NULL) {
-        return g_callback_eglGetCurrentContext();
+    INJECT(eglGetCurrentContext, EGL_NO_CONTEXT);
+    RESOLVE_HOOK(eglGetCurrentContext);
+    if(hook != NULL) {
+        return hook();
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetCurrentContext);
-    return g_eglGetCurrentContext();
+    CHECK_INIT(eglGetCurrentContext);
+    return dispatch_for_thread()->eglGetCurrentContext();
 }
 
 EGLSurface eglGetCurrentSurface(EGLint readdraw) {
-    if(g_callback_eglGetCurrentSurface != NULL) {
-        return g_callback_eglGetCurrentSurface(readdraw);
+    INJECT(eglGetCurrentSurface, EGL_NO_SURFACE);
+    RESOLVE_HOOK(eglGetCurrentSurface);
+    if(hook != NULL) {
+        return hook(readdraw);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetCurrentSurface);
-    return g_eglGetCurrentSurface(readdraw);
+    CHECK_INIT(eglGetCurrentSurface);
+    return dispatch_for_thread()->eglGetCurrentSurface(readdraw);
 }
 
 EGLDisplay eglGetCurrentDisplay(void) {
-    if(g_callback_eglGetCurrentDisplay != NULL) {
-        return g_callback_eglGetCurrentDisplay();
+    INJECT(eglGetCurrentDisplay, EGL_NO_DISPLAY);
+    RESOLVE_HOOK(eglGetCurrentDisplay);
+    if(hook != NULL) {
+        return hook();
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetCurrentDisplay);
-    return g_eglGetCurrentDisplay();
+    CHECK_INIT(eglGetCurrentDisplay);
+    return dispatch_for_thread()->eglGetCurrentDisplay();
 }
 
 EGLBoolean eglQueryContext(EGLDisplay dpy, EGLContext ctx, EGLint attribute, EGLint *value) {
-    if(g_callback_eglQueryContext != NULL) {
-        return g_callback_eglQueryContext(dpy, ctx, attribute, value);
+    INJECT(eglQueryContext, EGL_FALSE);
+    RESOLVE_HOOK(eglQueryContext);
+    if(hook != NULL) {
+        return hook(dpy, ctx, attribute, value);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglQueryContext);
-    return g_eglQueryContext(dpy, ctx, attribute, value);
+    CHECK_INIT(eglQueryContext);
+    return dispatch_for_display(dpy)->eglQueryContext(dpy, ctx, attribute, value);
 }
 
 EGLBoolean eglWaitGL(void) {
-    if(g_callback_eglWaitGL != NULL) {
-        return g_callback_eglWaitGL();
+    INJECT(eglWaitGL, EGL_FALSE);
+    RESOLVE_HOOK(eglWaitGL);
+    if(hook != NULL) {
+        return hook();
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglWaitGL);
-    return g_eglWaitGL();
+    CHECK_INIT(eglWaitGL);
+    return dispatch_for_thread()->eglWaitGL();
 }
 
 EGLBoolean eglWaitNative(EGLint engine) {
-    if(g_callback_eglWaitNative != NULL) {
-        return g_callback_eglWaitNative(engine);
+    INJECT(eglWaitNative, EGL_FALSE);
+    RESOLVE_HOOK(eglWaitNative);
+    if(hook != NULL) {
+        return hook(engine);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglWaitNative);
-    return g_eglWaitNative(engine);
+    CHECK_INIT(eglWaitNative);
+    return dispatch_for_thread()->eglWaitNative(engine);
 }
 
 EGLBoolean eglSwapBuffers(EGLDisplay dpy, EGLSurface surface) {
-    if(g_callback_eglSwapBuffers != NULL) {
-        return g_callback_eglSwapBuffers(dpy, surface);
+    INJECT(eglSwapBuffers, EGL_FALSE);
+    if(g_redundancy_enabled) {
+        redundancy_end_frame();
+    }
+    if(g_decimation_enabled && !decimation_should_present(surface)) {
+        // To the application, a skipped swap is a frame like any other.
+        EGLBoolean skipped = decimation_skip_swap();
+        if(g_injection_enabled && skipped == EGL_TRUE) {
+            injection_after_swap();
+        }
+        return skipped;
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglSwapBuffers);
-    return g_eglSwapBuffers(dpy, surface);
+    if(g_fences_enabled) {
+        fences_before_swap(dpy, surface);
+    }
+    EGLBoolean result;
+    RESOLVE_HOOK(eglSwapBuffers);
+    if(hook != NULL) {
+        result = hook(dpy, surface);
+    } else {
+        CHECK_INIT(eglSwapBuffers);
+        result = dispatch_for_display(dpy)->eglSwapBuffers(dpy, surface);
+    }
+    // Don't throttle failed swaps, that would also overwrite their error.
+    if(g_fences_enabled && result == EGL_TRUE) {
+        fences_after_swap(surface);
+    }
+    if(g_injection_enabled && result == EGL_TRUE) {
+        injection_after_swap();
+    }
+    if(g_render_threads_enabled) {
+        render_threads_after_swap();
+    }
+    return result;
 }
 
 EGLBoolean eglCopyBuffers(EGLDisplay dpy, EGLSurface surface, EGLNativePixmapType target) {
-    if(g_callback_eglCopyBuffers != NULL) {
-        return g_callback_eglCopyBuffers(dpy, surface, target);
+    INJECT(eglCopyBuffers, EGL_FALSE);
+    RESOLVE_HOOK(eglCopyBuffers);
+    if(hook != NULL) {
+        return hook(dpy, surface, target);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglCopyBuffers);
-    return g_eglCopyBuffers(dpy, surface, target);
+    CHECK_INIT(eglCopyBuffers);
+    return dispatch_for_display(dpy)->eglCopyBuffers(dpy, surface, target);
 }
 
 __eglMustCastToProperFunctionPointerType eglGetProcAddress(const char* proc_name) {
-    if(g_callback_eglGetProcAddress != NULL) {
-        return g_callback_eglGetProcAddress(proc_name);
+    INJECT(eglGetProcAddress, NULL);
+    uint64_t start = g_redundancy_enabled ? egl_wrapper_now_ns() : 0;
+    __eglMustCastToProperFunctionPointerType result;
+    RESOLVE_HOOK(eglGetProcAddress);
+    if(hook != NULL) {
+        result = hook(proc_name);
+    } else {
+        CHECK_INIT(eglGetProcAddress);
+        result = route_eglGetProcAddress(proc_name);
+    }
+    if(g_redundancy_enabled) {
+        redundancy_get_proc_address(__builtin_return_address(0), start, proc_name);
     }
-    CHECK_FUNC_PTR_AND_INIT(&g_eglGetProcAddress);
-    return g_eglGetProcAddress(proc_name);
+    return result;
 }
 
 void register_hook_eglGetError(EGLint (*hook)(void)) {
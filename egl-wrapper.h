@@ -6,11 +6,17 @@
 // The bare underlying EGL API is also accessible, through the
 // modified symbols in this header file.
 #include <EGL/egl.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 // Load the undelying (wrapped) EGL dynamically. This should be called
 // by the user's first contact callback.
 // Searching procedure:
 // - If library_path_optional is set, attempts to load from here.
+//   This may be a ':'-separated list to wrap several libraries, see below.
 // - Otherwise, if EGL_TO_WRAP env variable is set, attempts to use this.
 // - Otherwise, attempts to simply load "libEGL.so" to rely
 //   on the standard linker search paths.
@@ -20,12 +26,85 @@
 // TODO: proper error handling with a return code
 void egl_wrapper_initialize(const char* library_path_optional);
 
+// Policy deciding which wrapped library a new display is created on,
+// when several libraries are wrapped.
+// - FIRST: all displays are created on the first library.
+// - ROUND_ROBIN: each eglGetDisplay call goes to the next library.
+// - LEAST_CONTEXTS: eglGetDisplay goes to the library with the fewest
+//   live contexts.
+typedef enum {
+    EGL_WRAPPER_DISPLAY_POLICY_FIRST = 0,
+    EGL_WRAPPER_DISPLAY_POLICY_ROUND_ROBIN,
+    EGL_WRAPPER_DISPLAY_POLICY_LEAST_CONTEXTS
+} egl_wrapper_display_policy;
+
+// Several EGL libraries (e.g. of different GPU vendors) can be wrapped
+// at once, by passing a ':'-separated list of paths to
+// egl_wrapper_initialize or in EGL_TO_WRAP. Each display, and all
+// objects created from it, is then routed to the library which created
+// it. Calls without a display go to the library of the current context
+// of the calling thread, or to the first library. eglBindAPI and
+// eglReleaseThread go to all libraries.
+// The policy can also be set through the EGL_WRAPPER_DISPLAY_POLICY
+// environment variable ("first", "round-robin" or "least-contexts"),
+// which is read by egl_wrapper_initialize.
+// Displays are told apart by their handle alone: if a library returns a
+// display handle already returned by another library, eglGetDisplay
+// prints an error and fails with EGL_BAD_DISPLAY.
+// EGL extension functions returned by eglGetProcAddress are routed like
+// the other functions: by their first argument if it is a display,
+// otherwise to the library of the current context. Client API (e.g. GL)
+// functions belong to the library of the current context.
+void egl_wrapper_set_display_policy(egl_wrapper_display_policy policy);
+
+// Index (in the list of wrapped libraries) of the library owning a display.
+// Returns -1 if the wrapper is not initialized.
+int egl_wrapper_display_library(EGLDisplay dpy);
+
 // This function should be implemented by the user of this library.
 // It will be called when an EGL call is made and the wrapper is not
 // yet initialized. The user can use this to register any callbacks
 // necessary.
 void egl_wrapper_first_contact(const char* egl_fn_name);
 
+// The EGL functions which can be hooked, for X-macros. X is called with
+// the name of each function without its egl prefix.
+#define EGL_WRAPPER_ENTRIES(X) \
+    X(GetError) \
+    X(GetDisplay) \
+    X(Initialize) \
+    X(Terminate) \
+    X(QueryString) \
+    X(GetConfigs) \
+    X(ChooseConfig) \
+    X(GetConfigAttrib) \
+    X(CreateWindowSurface) \
+    X(CreatePbufferSurface) \
+    X(CreatePixmapSurface) \
+    X(DestroySurface) \
+    X(QuerySurface) \
+    X(BindAPI) \
+    X(QueryAPI) \
+    X(WaitClient) \
+    X(ReleaseThread) \
+    X(CreatePbufferFromClientBuffer) \
+    X(SurfaceAttrib) \
+    X(BindTexImage) \
+    X(ReleaseTexImage) \
+    X(SwapInterval) \
+    X(CreateContext) \
+    X(DestroyContext) \
+    X(MakeCurrent) \
+    X(GetCurrentContext) \
+    X(GetCurrentSurface) \
+    X(GetCurrentDisplay) \
+    X(QueryContext) \
+    X(WaitGL) \
+    X(WaitNative) \
+    X(SwapBuffers) \
+    X(CopyBuffers) \
+    X(GetProcAddress)
+
 // Access to the bare API.
 
 EGLAPI EGLint EGLAPIENTRY bare_eglGetError(void);
@@ -89,10 +168,7 @@ EGLAPI __eglMustCastToProperFunctionPointerType EGLAPIENTRY bare_eglGetProcAddre
 // in bare_eglXXXX.
 // Only one hook may be registered at a time.
 // Registering a NULL hook goes back to the original behavior.
-// The only API call for which there is no registration function is
-// eglCreateContext. That is because this library leaves that function
-// unimplemented. The user of this library can implement it as an entry
-// point to register all the needed callbacks.
+// For hooks written in C++, see also egl-wrapper.hpp.
 void register_hook_eglGetError(EGLint (*hook)(void));
 void register_hook_eglGetDisplay(EGLDisplay (*hook)(EGLNativeDisplayType display_id));
 void register_hook_eglInitialize(EGLBoolean (*hook)(EGLDisplay dpy, EGLint *major, EGLint *minor));
@@ -115,6 +191,7 @@ void register_hook_eglSurfaceAttrib(EGLBoolean (*hook)(EGLDisplay dpy, EGLSurfac
 void register_hook_eglBindTexImage(EGLBoolean (*hook)(EGLDisplay dpy, EGLSurface surface, EGLint buffer));
 void register_hook_eglReleaseTexImage(EGLBoolean (*hook)(EGLDisplay dpy, EGLSurface surface, EGLint buffer));
 void register_hook_eglSwapInterval(EGLBoolean (*hook)(EGLDisplay dpy, EGLint interval));
+void register_hook_eglCreateContext(EGLContext (*hook)(EGLDisplay dpy, EGLConfig config, EGLContext share_context, const EGLint *attrib_list));
 void register_hook_eglDestroyContext(EGLBoolean (*hook)(EGLDisplay dpy, EGLContext ctx));
 void register_hook_eglMakeCurrent(EGLBoolean (*hook)(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx));
 void register_hook_eglGetCurrentContext(EGLContext (*hook)(void));
@@ -127,4 +204,346 @@ void register_hook_eglSwapBuffers(EGLBoolean (*hook)(EGLDisplay dpy, EGLSurface
 void register_hook_eglCopyBuffers(EGLBoolean (*hook)(EGLDisplay dpy, EGLSurface surface, EGLNativePixmapType target));
 void register_hook_eglGetProcAddress(__eglMustCastToProperFunctionPointerType (*hook)(const char* procname));
 
+// Frame decimation.
+// When enabled, only every Nth call to eglSwapBuffers on a surface is
+// forwarded (to the registered eglSwapBuffers hook if any, otherwise to
+// the underlying EGL). The other swaps are replaced by a glFlush of the
+// current context and return EGL_TRUE, so the application still renders
+// every frame while only a fraction of them is presented.
+// - every_nth: forward one out of every_nth swaps. 0 or 1 means every swap.
+// - max_present_hz: if > 0, additionally forward at most this many swaps
+//   per second per surface. A swap held back by this limit is forwarded
+//   as soon as the interval has passed, and the every_nth count restarts
+//   from the last forwarded swap.
+// Calling with (1, 0) disables decimation.
+// The same policy can be set without code changes through the
+// EGL_WRAPPER_PRESENT_EVERY_NTH and EGL_WRAPPER_MAX_PRESENT_HZ environment
+// variables, which are read by egl_wrapper_initialize.
+void egl_wrapper_set_frame_decimation(unsigned int every_nth, double max_present_hz);
+
+typedef struct {
+    unsigned long long presented;
+    unsigned long long skipped;
+} egl_wrapper_decimation_stats;
+
+// Get the number of swaps forwarded and skipped so far (over all surfaces).
+void egl_wrapper_get_decimation_stats(egl_wrapper_decimation_stats* stats);
+
+// GPU completion timing.
+// When enabled, a fence (EGL_KHR_fence_sync) is inserted right before each
+// forwarded eglSwapBuffers. A background thread waits on these fences and
+// records when the GPU actually finished each frame, without ever blocking
+// the render thread. A frame is classified as GPU-bound if the next frame
+// of the same surface was already submitted by the time its fence
+// signaled, and as CPU-bound otherwise.
+// If the display does not support EGL_KHR_fence_sync or no context is
+// current, no timing is recorded for that frame.
+// Can also be enabled by setting the EGL_WRAPPER_GPU_TIMING environment
+// variable to 1 before egl_wrapper_initialize is called.
+void egl_wrapper_enable_gpu_timing(bool enable);
+
+typedef struct {
+    unsigned long long frame;       // index of the forwarded swap, from 0
+    EGLSurface surface;
+    unsigned long long submit_ns;   // CLOCK_MONOTONIC time the fence was inserted
+    unsigned long long complete_ns; // CLOCK_MONOTONIC time the fence was seen signaled
+    bool gpu_bound;
+} egl_wrapper_gpu_frame_info;
+
+typedef struct {
+    unsigned long long frames;          // frames for which completion was observed
+    unsigned long long gpu_bound_frames;
+    unsigned long long cpu_bound_frames;
+    unsigned long long dropped_frames;  // frames without a fence (unsupported or queue full)
+    double last_latency_ms;             // submit to GPU completion
+    double avg_latency_ms;
+    double max_latency_ms;
+} egl_wrapper_gpu_timing_stats;
+
+// Register a callback which receives the timing of every frame. It is
+// called from the background thread. Registering NULL removes it.
+void egl_wrapper_set_gpu_timing_callback(void (*callback)(const egl_wrapper_gpu_frame_info* info));
+
+void egl_wrapper_get_gpu_timing_stats(egl_wrapper_gpu_timing_stats* stats);
+
+// Frames-in-flight limiter.
+// Limits how many frames may be queued on the GPU, to bound render-ahead
+// latency. This uses the same fences as GPU timing: when more than
+// max_frames frames of a surface have not completed on the GPU after a
+// forwarded eglSwapBuffers on it, the swap waits on the surface's oldest
+// fence before returning. Each surface is limited on its own, so a
+// GPU-bound surface doesn't throttle the others. 0 disables the limiter.
+// Can also be set through the EGL_WRAPPER_MAX_FRAMES_IN_FLIGHT environment
+// variable before egl_wrapper_initialize is called.
+void egl_wrapper_set_max_frames_in_flight(unsigned int max_frames);
+
+typedef struct {
+    unsigned int max_frames_in_flight;  // configured limit, 0 if disabled
+    unsigned int frames_in_flight;      // current queue depth of the deepest surface
+    unsigned long long throttled_swaps; // swaps which had to wait
+    double throttle_time_ms;            // total time spent waiting
+} egl_wrapper_frame_limiter_stats;
+
+void egl_wrapper_get_frame_limiter_stats(egl_wrapper_frame_limiter_stats* stats);
+
+// Render thread policy.
+// When set, the policy is applied to each thread the first time it makes
+// a context current through eglMakeCurrent, and the CPU cores render
+// threads run on are recorded (sampled at each eglSwapBuffers).
+typedef enum {
+    EGL_WRAPPER_SCHED_UNCHANGED = 0,
+    EGL_WRAPPER_SCHED_OTHER,
+    EGL_WRAPPER_SCHED_FIFO,
+    EGL_WRAPPER_SCHED_RR
+} egl_wrapper_sched_policy;
+
+typedef struct {
+    const char* cpus;       // CPU list to pin to, e.g. "0-3,8". NULL to leave unchanged.
+    bool set_nice;
+    int nice;               // nice level, applied if set_nice
+    egl_wrapper_sched_policy sched_policy;
+    int sched_priority;     // for SCHED_FIFO / SCHED_RR
+} egl_wrapper_render_thread_policy;
+
+// Set the policy for threads which make a context current from now on.
+// Passing NULL disables it. The cpus string is parsed immediately and
+// need not outlive the call.
+// The same can be configured through environment variables read by
+// egl_wrapper_initialize:
+// - EGL_WRAPPER_RENDER_CPUS: CPU list, e.g. "0-3,8"
+// - EGL_WRAPPER_RENDER_NICE: nice level
+// - EGL_WRAPPER_RENDER_SCHED: "fifo:<priority>", "rr:<priority>" or "other"
+// Failures to apply (e.g. missing privileges for SCHED_FIFO) are printed
+// and otherwise ignored.
+void egl_wrapper_set_render_thread_policy(const egl_wrapper_render_thread_policy* policy);
+
+typedef struct {
+    int tid;
+    bool pinned;            // whether the CPU affinity was applied
+    int first_cpu;          // core at the first eglMakeCurrent
+    int last_cpu;           // core at the last eglSwapBuffers
+    unsigned long long migrations; // core changes seen between swaps
+} egl_wrapper_render_thread_info;
+
+// Get the render threads seen so far which haven't exited. Returns the
+// number of entries written.
+unsigned int egl_wrapper_get_render_threads(egl_wrapper_render_thread_info* threads, unsigned int max_threads);
+
+// Redundant-call analysis.
+// When enabled, the calls below are checked for being redundant, and the
+// time spent in redundant calls (including hooks) is measured:
+// - eglMakeCurrent to the binding already current on the thread;
+// - eglQuerySurface returning the same value as the same query earlier
+//   in the frame;
+// - eglGetConfigAttrib returning the same value as the same query before;
+// - eglGetProcAddress for a name which was looked up before;
+// - eglGetError returning EGL_SUCCESS right after an eglGetError which did
+//   so too, with no other EGL call of the thread in between (polling);
+// - eglSwapInterval setting the interval already set for the surface.
+// A frame of a thread ends at its eglSwapBuffers. Calls are attributed
+// to their call site (the return address of the EGL call).
+// Can also be enabled by setting the EGL_WRAPPER_REDUNDANCY_REPORT
+// environment variable to 1 before egl_wrapper_initialize is called, in
+// which case the report is printed at exit.
+void egl_wrapper_enable_redundancy_analysis(bool enable);
+
+typedef enum {
+    EGL_WRAPPER_REDUNDANT_MAKE_CURRENT = 0,
+    EGL_WRAPPER_REDUNDANT_QUERY_SURFACE,
+    EGL_WRAPPER_REDUNDANT_GET_CONFIG_ATTRIB,
+    EGL_WRAPPER_REDUNDANT_GET_PROC_ADDRESS,
+    EGL_WRAPPER_REDUNDANT_GET_ERROR,
+    EGL_WRAPPER_REDUNDANT_SWAP_INTERVAL,
+    EGL_WRAPPER_REDUNDANT_NUM_KINDS
+} egl_wrapper_redundant_call;
+
+typedef struct {
+    unsigned long long frame;       // index of the frame, over all threads
+    unsigned long long calls[EGL_WRAPPER_REDUNDANT_NUM_KINDS];
+    unsigned long long redundant[EGL_WRAPPER_REDUNDANT_NUM_KINDS];
+    unsigned long long wasted_ns;   // time spent in the redundant calls
+} egl_wrapper_redundancy_frame;
+
+typedef struct {
+    unsigned long long frames;
+    unsigned long long calls[EGL_WRAPPER_REDUNDANT_NUM_KINDS];
+    unsigned long long redundant[EGL_WRAPPER_REDUNDANT_NUM_KINDS];
+    unsigned long long wasted_ns[EGL_WRAPPER_REDUNDANT_NUM_KINDS];
+    unsigned long long total_redundant;
+    unsigned long long total_wasted_ns;
+    unsigned long long worst_frame;           // frame with the most time wasted
+    unsigned long long worst_frame_wasted_ns;
+} egl_wrapper_redundancy_stats;
+
+typedef struct {
+    void* call_site;
+    egl_wrapper_redundant_call kind;
+    unsigned long long calls;
+    unsigned long long redundant;
+    unsigned long long total_ns;    // time spent in all calls from this site
+    unsigned long long wasted_ns;   // time spent in the redundant ones
+} egl_wrapper_redundancy_site;
+
+// Register a callback which receives the summary of every frame, called
+// from the thread which swapped. Registering NULL removes it.
+void egl_wrapper_set_redundancy_frame_callback(void (*callback)(const egl_wrapper_redundancy_frame* frame));
+
+void egl_wrapper_get_redundancy_stats(egl_wrapper_redundancy_stats* stats);
+
+// Get the call sites seen so far, most time wasted first. Returns the
+// number of entries written.
+unsigned int egl_wrapper_get_redundancy_sites(egl_wrapper_redundancy_site* sites, unsigned int max_sites);
+
+// Print totals, per-frame averages and the worst call sites to stdout.
+void egl_wrapper_print_redundancy_report(void);
+
+// Hook plugins.
+// Hooks can also be loaded from plugins: shared libraries which export
+//   void egl_wrapper_plugin_init(egl_wrapper_plugin_hooks* hooks);
+// and fill in the hooks they want (the struct is zeroed beforehand). The
+// hooks have the same semantics as registered hooks, and may call the
+// bare_eglXXXX functions. A plugin may also export
+//   void egl_wrapper_plugin_shutdown(void);
+// which is called before it is unloaded.
+// If several plugins hook the same call, the first one listed wins.
+// Plugin hooks are kept apart from hooks registered with
+// register_hook_eglXXXX: while a plugin hooks a call, it is used instead
+// of the registered hook, which is used again once no plugin hooks the
+// call anymore.
+typedef struct {
+    EGLint (*eglGetError)(void);
+    EGLDisplay (*eglGetDisplay)(EGLNativeDisplayType display_id);
+    EGLBoolean (*eglInitialize)(EGLDisplay dpy, EGLint *major, EGLint *minor);
+    EGLBoolean (*eglTerminate)(EGLDisplay dpy);
+    const char * (*eglQueryString)(EGLDisplay dpy, EGLint name);
+    EGLBoolean (*eglGetConfigs)(EGLDisplay dpy, EGLConfig *configs, EGLint config_size, EGLint *num_config);
+    EGLBoolean (*eglChooseConfig)(EGLDisplay dpy, const EGLint *attrib_list, EGLConfig *configs, EGLint config_size, EGLint *num_config);
+    EGLBoolean (*eglGetConfigAttrib)(EGLDisplay dpy, EGLConfig config, EGLint attribute, EGLint *value);
+    EGLSurface (*eglCreateWindowSurface)(EGLDisplay dpy, EGLConfig config, EGLNativeWindowType win, const EGLint *attrib_list);
+    EGLSurface (*eglCreatePbufferSurface)(EGLDisplay dpy, EGLConfig config, const EGLint *attrib_list);
+    EGLSurface (*eglCreatePixmapSurface)(EGLDisplay dpy, EGLConfig config, EGLNativePixmapType pixmap, const EGLint *attrib_list);
+    EGLBoolean (*eglDestroySurface)(EGLDisplay dpy, EGLSurface surface);
+    EGLBoolean (*eglQuerySurface)(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint *value);
+    EGLBoolean (*eglBindAPI)(EGLenum api);
+    EGLenum (*eglQueryAPI)(void);
+    EGLBoolean (*eglWaitClient)(void);
+    EGLBoolean (*eglReleaseThread)(void);
+    EGLSurface (*eglCreatePbufferFromClientBuffer)(EGLDisplay dpy, EGLenum buftype, EGLClientBuffer buffer, EGLConfig config, const EGLint *attrib_list);
+    EGLBoolean (*eglSurfaceAttrib)(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint value);
+    EGLBoolean (*eglBindTexImage)(EGLDisplay dpy, EGLSurface surface, EGLint buffer);
+    EGLBoolean (*eglReleaseTexImage)(EGLDisplay dpy, EGLSurface surface, EGLint buffer);
+    EGLBoolean (*eglSwapInterval)(EGLDisplay dpy, EGLint interval);
+    EGLContext (*eglCreateContext)(EGLDisplay dpy, EGLConfig config, EGLContext share_context, const EGLint *attrib_list);
+    EGLBoolean (*eglDestroyContext)(EGLDisplay dpy, EGLContext ctx);
+    EGLBoolean (*eglMakeCurrent)(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx);
+    EGLContext (*eglGetCurrentContext)(void);
+    EGLSurface (*eglGetCurrentSurface)(EGLint readdraw);
+    EGLDisplay (*eglGetCurrentDisplay)(void);
+    EGLBoolean (*eglQueryContext)(EGLDisplay dpy, EGLContext ctx, EGLint attribute, EGLint *value);
+    EGLBoolean (*eglWaitGL)(void);
+    EGLBoolean (*eglWaitNative)(EGLint engine);
+    EGLBoolean (*eglSwapBuffers)(EGLDisplay dpy, EGLSurface surface);
+    EGLBoolean (*eglCopyBuffers)(EGLDisplay dpy, EGLSurface surface, EGLNativePixmapType target);
+    __eglMustCastToProperFunctionPointerType (*eglGetProcAddress)(const char* proc_name);
+} egl_wrapper_plugin_hooks;
+
+// Load plugins from plugin_list (':'-separated paths) and/or config_path
+// (a file with one path per line, '#' for comments), replacing any
+// plugins loaded before. If watch is set, plugins are reloaded when
+// SIGHUP is received (unless the application handles it) or when the
+// config file or a plugin file changes. The plugins watched follow the
+// config file across reloads.
+// Reloading publishes the new hooks atomically; the old plugins are only
+// unloaded once all calls in flight through them have returned.
+// The EGL_WRAPPER_PLUGINS and EGL_WRAPPER_PLUGIN_CONFIG environment
+// variables are read by egl_wrapper_initialize, with watching enabled.
+void egl_wrapper_load_plugins(const char* plugin_list, const char* config_path, bool watch);
+
+// Reload the configured plugins now. Must not be called from a hook.
+void egl_wrapper_reload_plugins(void);
+
+// Scoped hooks.
+// A set of hooks (in the same struct as plugins use) can be registered
+// for a scope, and then only applies to calls made by a thread while the
+// scope is bound through eglMakeCurrent:
+// - CONTEXT: while the given context is current;
+// - SURFACE: while the given surface is the draw or read surface;
+// - DISPLAY: while a context of the given display is current;
+// - THREAD: always, on the thread with the given kernel thread id (as
+//   returned by gettid), or on the calling thread if object is NULL.
+// If several scopes hook the same call, the most specific one (in the
+// order above) wins. Scoped hooks take precedence over hooks registered
+// with register_hook_eglXXXX and plugins.
+// Calls from threads without scoped hooks only pay two loads and
+// branches for this (three once any scoped hooks were registered).
+// Scopes are matched against the binding as of the thread's last
+// eglMakeCurrent (or the binding when the scoped hooks last changed), not
+// against the arguments of each call.
+// Registering again for the same scope and object replaces the hooks.
+// Scopes should be unregistered before their object is destroyed, as the
+// handle may be reused. Returns false if too many scopes are registered.
+typedef enum {
+    EGL_WRAPPER_SCOPE_CONTEXT = 0,
+    EGL_WRAPPER_SCOPE_SURFACE,
+    EGL_WRAPPER_SCOPE_DISPLAY,
+    EGL_WRAPPER_SCOPE_THREAD
+} egl_wrapper_scope;
+
+bool egl_wrapper_register_scoped_hooks(egl_wrapper_scope scope, void* object, const egl_wrapper_plugin_hooks* hooks);
+void egl_wrapper_unregister_scoped_hooks(egl_wrapper_scope scope, void* object);
+
+// Latency and failure injection.
+// Rules make calls slower or fail, to test how the application copes
+// with a slow or flaky driver. They are loaded from a file where each line
+// (after removing '#' comments) is:
+//
+//   entry[,entry...] action [condition...]
+//
+// Entries are EGL function names, or "*" for all of them. Actions:
+// - delay=TIME: sleep before the call. TIME is a number with an optional
+//   ns, us, ms (the default) or s suffix, or a distribution to sample:
+//   uniform:MIN:MAX, normal:MEAN:STDDEV or exponential:MEAN;
+// - error=NAME: fail the call without calling hooks or the wrapped
+//   library, returning its failure value (EGL_FALSE, EGL_NO_SURFACE...).
+//   The thread's next eglGetError returns the error, given as a name
+//   (e.g. EGL_BAD_ALLOC, EGL_CONTEXT_LOST) or a number. Functions which
+//   can't fail (e.g. eglGetCurrentContext) are skipped.
+// Conditions (all must hold):
+// - threads=LIST: only on the threads with these kernel thread ids or
+//   names (as set by pthread_setname_np);
+// - after_frames=N: only once the calling thread made N successful
+//   eglSwapBuffers (including those skipped by frame decimation);
+// - for_frames=N: only for N frames of the thread (after after_frames);
+// - every=N: only on every Nth call meeting the conditions above, e.g.
+//   for periodic stalls;
+// - probability=P: only with probability P (0 to 1);
+// - count=N: at most N times.
+// For example:
+//
+//   eglSwapBuffers delay=normal:4ms:1ms
+//   eglSwapBuffers delay=250ms every=120
+//   eglMakeCurrent error=EGL_CONTEXT_LOST after_frames=300 count=1
+//
+// Random numbers are derived from EGL_WRAPPER_INJECT_SEED (default 1),
+// the rule's line and the index of the call among the rule's calls, so
+// that a run is reproducible as long as each rule's calls come in the
+// same order (e.g. from one thread).
+// For each error rule, the report gives the time from the last injected
+// error on a thread to the next successful eglSwapBuffers of that thread,
+// or to an error of another rule on that thread (the recovery time).
+// The rules can also be loaded by setting EGL_WRAPPER_INJECT_RULES to
+// the file before egl_wrapper_initialize is called, in which case the
+// report is printed at exit.
+// Loading replaces the previous rules; NULL removes them. Returns false
+// (keeping the previous rules) if the file can't be read or has an
+// invalid rule.
+bool egl_wrapper_load_injection_rules(const char* path);
+
+// Print what each rule injected and the recovery times to stderr.
+void egl_wrapper_print_injection_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
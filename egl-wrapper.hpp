@@ -0,0 +1,121 @@
+#ifndef WRAPPED_EGL_HPP
+#define WRAPPED_EGL_HPP
+
+// Header-only C++ (17 or later) API to compose hooks at compile time.
+//
+// Instead of writing a complete replacement function for an EGL call, a
+// hook is described by handlers which run before (pre) and after (post)
+// the bare EGL call:
+//
+//   struct count_frames {
+//       void operator()(EGLDisplay dpy, EGLSurface surface) const { ++g_frames; }
+//   };
+//   struct check_result {
+//       void operator()(EGLBoolean& result, EGLDisplay dpy, EGLSurface surface) const { ... }
+//   };
+//
+//   egl_wrapper::hook<egl_wrapper::Entry::SwapBuffers,
+//                     egl_wrapper::pre<count_frames>,
+//                     egl_wrapper::post<check_result>>::install();
+//
+// The handlers are composed into a single trampoline function, in which
+// they can all be inlined. Stacked instrumentation therefore costs one
+// call to the trampoline instead of one indirect call per handler.
+// The signatures are derived from the EGL prototypes, so handlers which
+// don't match are rejected at compile time.
+//
+// - Pre handlers are called with the arguments of the call, as lvalues
+//   (they may modify them).
+// - Post handlers are called with the result (as an lvalue, which they
+//   may modify) followed by the arguments.
+// - Handlers are default-constructed at every call, so they must be
+//   stateless types: function objects, or captureless lambdas
+//   (decltype([](...) {...}), C++20). Plain functions can be used
+//   through egl_wrapper::fn<&function>.
+//
+// install() registers the trampoline through register_hook_eglXXX, so
+// it replaces any hook registered before for the same call.
+
+#include "egl-wrapper.h"
+
+#include <type_traits>
+#include <utility>
+
+namespace egl_wrapper {
+
+// Calls which can be hooked, listed by EGL_WRAPPER_ENTRIES (egl-wrapper.h).
+#define EGL_WRAPPER_ENUM_ENTRY(NAME) NAME,
+enum class Entry {
+    EGL_WRAPPER_ENTRIES(EGL_WRAPPER_ENUM_ENTRY)
+};
+#undef EGL_WRAPPER_ENUM_ENTRY
+
+// Lists of handler types.
+template<class... Handlers> struct pre {};
+template<class... Handlers> struct post {};
+
+// Adapts a plain function (or any constant callable) into a handler type.
+template<auto F>
+struct fn {
+    template<class... Args>
+    decltype(auto) operator()(Args&&... args) const {
+        return F(std::forward<Args>(args)...);
+    }
+};
+
+// entry_traits<E>::bare is the bare EGL function of an entry, and
+// entry_traits<E>::register_hook its hook registration function.
+template<Entry E> struct entry_traits;
+
+#define EGL_WRAPPER_ENTRY_TRAITS(NAME) \
+    template<> struct entry_traits<Entry::NAME> { \
+        static constexpr auto bare = &::bare_egl##NAME; \
+        static void register_hook(decltype(&::bare_egl##NAME) hook) { \
+            ::register_hook_egl##NAME(hook); \
+        } \
+    };
+EGL_WRAPPER_ENTRIES(EGL_WRAPPER_ENTRY_TRAITS)
+#undef EGL_WRAPPER_ENTRY_TRAITS
+
+namespace detail {
+
+template<Entry E, class Signature, class Pre, class Post>
+struct trampoline;
+
+template<Entry E, class R, class... Args, class... Pre, class... Post>
+struct trampoline<E, R (*)(Args...), pre<Pre...>, post<Post...>> {
+    static_assert((std::is_invocable_v<const Pre&, Args&...> && ...),
+        "pre handler can't be called with the arguments of this EGL call");
+    static_assert((std::is_invocable_v<const Post&, R&, Args&...> && ...),
+        "post handler can't be called with the result and arguments of this EGL call");
+
+    static R EGLAPIENTRY call(Args... args) {
+        (Pre{}(args...), ...);
+        R result = entry_traits<E>::bare(args...);
+        (Post{}(result, args...), ...);
+        return result;
+    }
+};
+
+} // namespace detail
+
+template<Entry E, class Pre = pre<>, class Post = post<>>
+struct hook {
+    using trampoline = detail::trampoline<E,
+        std::remove_const_t<decltype(entry_traits<E>::bare)>, Pre, Post>;
+
+    // The generated function, with the signature of the EGL call.
+    static constexpr auto function = &trampoline::call;
+
+    static void install() {
+        entry_traits<E>::register_hook(function);
+    }
+
+    static void uninstall() {
+        entry_traits<E>::register_hook(nullptr);
+    }
+};
+
+} // namespace egl_wrapper
+
+#endif
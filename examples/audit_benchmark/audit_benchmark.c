@@ -0,0 +1,49 @@
+// This example measures the per-call overhead of the ways egl-wrapper can
+// be injected. It builds two things:
+//
+// - audit_benchmark, an application linked to the system libEGL which
+//   times a few cheap EGL calls in a tight loop;
+// - libaudit_benchmark_hooks.so, a wrapper library which hooks only
+//   eglSwapBuffers (with a hook which just forwards).
+//
+// Run ./audit_benchmark three times:
+//
+// - as is;
+// - with LD_PRELOAD="/path/to/libegl-wrapper.so ./libaudit_benchmark_hooks.so";
+// - with the same LD_PRELOAD, LD_AUDIT=/path/to/libegl-wrapper-audit.so
+//   and EGL_WRAPPER_AUDIT_HOOKS=eglSwapBuffers.
+//
+// libegl-wrapper.so is preloaded too, because it is the library which
+// exports the EGL functions and it must come before the system libEGL.
+//
+// With LD_PRELOAD alone, every call goes through the wrapper. With
+// LD_AUDIT as well, the unhooked calls should cost the same as without
+// the wrapper, while eglSwapBuffers still reaches the hook.
+// The calls are made without a display, so no GPU is needed.
+
+#include <egl-wrapper.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+static unsigned long g_hooked_swaps = 0;
+
+static EGLBoolean my_eglSwapBuffers(EGLDisplay dpy, EGLSurface surface) {
+    g_hooked_swaps++;
+    return bare_eglSwapBuffers(dpy, surface);
+}
+
+void egl_wrapper_first_contact(const char* egl_fn_name) {
+    static bool registered = false;
+
+    if(!registered) {
+        egl_wrapper_initialize(NULL);
+        register_hook_eglSwapBuffers(my_eglSwapBuffers);
+        registered = true;
+    }
+}
+
+// Only defined in the hooks library, see CMakeLists.txt.
+unsigned long audit_benchmark_hooked_swaps(void) {
+    return g_hooked_swaps;
+}
@@ -0,0 +1,45 @@
+// Application side of the audit_benchmark example, see audit_benchmark.c.
+
+#define _GNU_SOURCE
+
+#include <EGL/egl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#define ITERATIONS 10000000
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#define MEASURE(NAME, CALL) \
+    do { \
+        CALL; \
+        uint64_t start = now_ns(); \
+        for(long i = 0; i < ITERATIONS; i++) { \
+            CALL; \
+        } \
+        printf("%-22s %6.2f ns/call\n", NAME, (double)(now_ns() - start) / ITERATIONS); \
+    } while(0)
+
+int main(void) {
+    MEASURE("eglGetError", eglGetError());
+    MEASURE("eglGetCurrentContext", eglGetCurrentContext());
+    MEASURE("eglQueryAPI", eglQueryAPI());
+    MEASURE("eglSwapBuffers", eglSwapBuffers(EGL_NO_DISPLAY, EGL_NO_SURFACE));
+
+    // Check that the hook was reached, if the wrapper is loaded.
+    unsigned long (*hooked_swaps)(void) =
+        (unsigned long (*)(void))dlsym(RTLD_DEFAULT, "audit_benchmark_hooked_swaps");
+    if(hooked_swaps != NULL) {
+        printf("eglSwapBuffers hook called %lu times\n", hooked_swaps());
+    } else {
+        printf("No wrapper loaded\n");
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+// This example shows the header-only C++ hook API from egl-wrapper.hpp.
+// Like slow_render, it compiles a dynamic library to be used in place of
+// libEGL (see slow_render.c for how to use it, including EGL_TO_WRAP).
+//
+// Two independent pieces of instrumentation are stacked on eglSwapBuffers:
+// a frame counter which prints the frame rate every second, and a check
+// which reports failed swaps. Both are composed into one trampoline at
+// compile time, so the application pays for a single hook call.
+// eglMakeCurrent gets a post handler which reports context switches.
+
+#include <egl-wrapper.hpp>
+
+#include <chrono>
+#include <cstdio>
+
+namespace {
+
+struct count_frames {
+    void operator()(EGLDisplay, EGLSurface) const {
+        using clock = std::chrono::steady_clock;
+        static unsigned int frames = 0;
+        static clock::time_point start = clock::now();
+
+        frames++;
+        auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        if(elapsed >= 1.0) {
+            std::printf("%.1f frames per second\n", frames / elapsed);
+            frames = 0;
+            start = clock::now();
+        }
+    }
+};
+
+struct report_failed_swap {
+    void operator()(EGLBoolean& result, EGLDisplay, EGLSurface surface) const {
+        if(result != EGL_TRUE) {
+            std::printf("eglSwapBuffers failed on surface %p\n", surface);
+        }
+    }
+};
+
+void report_make_current(EGLBoolean& result, EGLDisplay, EGLSurface draw, EGLSurface, EGLContext ctx) {
+    std::printf("eglMakeCurrent(draw %p, context %p) -> %d\n", draw, ctx, result);
+}
+
+} // namespace
+
+extern "C" void egl_wrapper_first_contact(const char* egl_fn_name) {
+    static bool registered = false;
+
+    if(!registered) {
+        egl_wrapper_initialize(NULL);
+
+        egl_wrapper::hook<egl_wrapper::Entry::SwapBuffers,
+                          egl_wrapper::pre<count_frames>,
+                          egl_wrapper::post<report_failed_swap>>::install();
+
+        egl_wrapper::hook<egl_wrapper::Entry::MakeCurrent,
+                          egl_wrapper::pre<>,
+                          egl_wrapper::post<egl_wrapper::fn<&report_make_current>>>::install();
+
+        std::printf("Registered C++ hooks.\n");
+        registered = true;
+    }
+}
@@ -0,0 +1,320 @@
+// This example is a synthetic frame loop, to evaluate egl-wrapper and its
+// features quantitatively on a machine without a GPU. It runs against the
+// stub driver built next to it (libstub_egl.so), whose latencies are
+// scripted by a profile file (see tests/stub_egl.c, built with
+// STUB_LATENCY_PROFILE, and the profiles folder).
+//
+// Several render threads each get a display, and render to several
+// pbuffer surfaces. Each frame of a surface does what a typical engine
+// does: eglMakeCurrent, querying the surface size, eglSwapBuffers and
+// checking eglGetError.
+// At the end, the benchmark reports throughput, frame time percentiles
+// and the CPU overhead the wrapper adds to a frame.
+//
+// frame_benchmark [-p profile] [-t threads] [-s surfaces per thread]
+//                 [-f frames] [-i swap interval]
+//
+// For example, to see the effect of the frames-in-flight limiter on a
+// slow mobile driver:
+//
+// ./frame_benchmark -p profiles/mobile.profile
+// EGL_WRAPPER_MAX_FRAMES_IN_FLIGHT=1 ./frame_benchmark -p profiles/mobile.profile
+//
+// Or, to see how it copes with a flaky driver (see the rules folder):
+//
+// EGL_WRAPPER_INJECT_RULES=rules/flaky.rules ./frame_benchmark
+//
+// EGL_TO_WRAP can point to another driver instead of the stub. It can
+// also list a second copy of the stub, to spread the render threads'
+// displays over two drivers, with
+// EGL_TO_WRAP=./libstub_egl.so:./libstub_egl_second.so and
+// EGL_WRAPPER_DISPLAY_POLICY=round-robin.
+
+#define _GNU_SOURCE
+
+#include <egl-wrapper.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#define MAX_SURFACES 16
+#define OVERHEAD_ITERATIONS 200000
+
+// Types
+
+// The calls made in a frame, either through the wrapper or directly
+// to the driver.
+typedef struct {
+    EGLBoolean (*eglMakeCurrent)(EGLDisplay, EGLSurface, EGLSurface, EGLContext);
+    EGLBoolean (*eglQuerySurface)(EGLDisplay, EGLSurface, EGLint, EGLint *);
+    EGLBoolean (*eglSwapBuffers)(EGLDisplay, EGLSurface);
+    EGLint (*eglGetError)(void);
+} frame_calls;
+
+typedef struct {
+    pthread_t thread;
+    unsigned int index;
+    bool init_failed;
+    EGLDisplay dpy;
+    EGLConfig config;
+    uint64_t* frame_ns;
+    unsigned int failed_frames;
+    unsigned int lost_contexts;
+} render_thread;
+
+// Globals
+static unsigned int g_num_threads = 2;
+static unsigned int g_num_surfaces = 2;
+static unsigned int g_num_frames = 300;
+static EGLint g_swap_interval = 1;
+
+static const EGLint g_config_attribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_NONE };
+
+static const frame_calls g_wrapped_calls = {
+    eglMakeCurrent,
+    eglQuerySurface,
+    eglSwapBuffers,
+    eglGetError
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void egl_wrapper_first_contact(const char* egl_fn_name) {
+    (void)egl_fn_name;
+    egl_wrapper_initialize(NULL);
+}
+
+// Returns the error of the first failed call, or EGL_SUCCESS.
+static EGLint render_surface(const frame_calls* egl, EGLDisplay dpy, EGLSurface surface, EGLContext ctx) {
+    EGLint width, height;
+    // Stop at the first failed call, so that eglGetError returns its error.
+    (void)(egl->eglMakeCurrent(dpy, surface, surface, ctx) &&
+        egl->eglQuerySurface(dpy, surface, EGL_WIDTH, &width) &&
+        egl->eglQuerySurface(dpy, surface, EGL_HEIGHT, &height) &&
+        egl->eglSwapBuffers(dpy, surface));
+    return egl->eglGetError();
+}
+
+static void* render_thread_main(void* arg) {
+    render_thread* t = arg;
+    // Named so that injection rules can target a thread.
+    char name[16];
+    snprintf(name, sizeof(name), "frame_bench_%u", t->index);
+    pthread_setname_np(pthread_self(), name);
+
+    const EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    const EGLint surface_attribs[] = { EGL_WIDTH, 256, EGL_HEIGHT, 256, EGL_NONE };
+
+    // With several drivers wrapped, each display may be another driver's.
+    t->dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint num_configs = 0;
+    if(!eglInitialize(t->dpy, NULL, NULL) ||
+        !eglChooseConfig(t->dpy, g_config_attribs, &t->config, 1, &num_configs) || num_configs == 0) {
+        fprintf(stderr, "Render thread %u: no EGL display\n", t->index);
+        t->init_failed = true;
+        return NULL;
+    }
+
+    EGLContext ctx = eglCreateContext(t->dpy, t->config, EGL_NO_CONTEXT, context_attribs);
+    EGLSurface surfaces[MAX_SURFACES];
+    for(unsigned int s = 0; s < g_num_surfaces; s++) {
+        surfaces[s] = eglCreatePbufferSurface(t->dpy, t->config, surface_attribs);
+        eglMakeCurrent(t->dpy, surfaces[s], surfaces[s], ctx);
+        eglSwapInterval(t->dpy, g_swap_interval);
+    }
+
+    uint64_t last = now_ns();
+    for(unsigned int f = 0; f < g_num_frames; f++) {
+        for(unsigned int s = 0; s < g_num_surfaces; s++) {
+            EGLint error = render_surface(&g_wrapped_calls, t->dpy, surfaces[s], ctx);
+            if(error == EGL_SUCCESS) {
+                continue;
+            }
+            t->failed_frames++;
+            // What an application has to do to recover.
+            if(error == EGL_CONTEXT_LOST) {
+                t->lost_contexts++;
+                eglMakeCurrent(t->dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+                eglDestroyContext(t->dpy, ctx);
+                ctx = eglCreateContext(t->dpy, t->config, EGL_NO_CONTEXT, context_attribs);
+            }
+        }
+        uint64_t now = now_ns();
+        t->frame_ns[f] = now - last;
+        last = now;
+    }
+
+    eglMakeCurrent(t->dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    for(unsigned int s = 0; s < g_num_surfaces; s++) {
+        eglDestroySurface(t->dpy, surfaces[s]);
+    }
+    eglDestroyContext(t->dpy, ctx);
+    eglReleaseThread();
+    return NULL;
+}
+
+// CPU time of one surface frame, with the driver's latencies disabled.
+static double measure_frame_cpu_ns(const frame_calls* egl, EGLDisplay dpy, EGLConfig config) {
+    EGLContext ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, NULL);
+    EGLSurface surface = eglCreatePbufferSurface(dpy, config, NULL);
+    for(int i = 0; i < OVERHEAD_ITERATIONS / 10; i++) {
+        render_surface(egl, dpy, surface, ctx);
+    }
+    uint64_t start = now_ns();
+    for(int i = 0; i < OVERHEAD_ITERATIONS; i++) {
+        render_surface(egl, dpy, surface, ctx);
+    }
+    double result = (double)(now_ns() - start) / OVERHEAD_ITERATIONS;
+    eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroySurface(dpy, surface);
+    eglDestroyContext(dpy, ctx);
+    return result;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static double percentile_ms(const uint64_t* sorted, size_t n, double p) {
+    size_t index = (size_t)(p / 100.0 * (double)(n - 1) + 0.5);
+    return sorted[index] / 1e6;
+}
+
+int main(int argc, char** argv) {
+    const char* profile = NULL;
+    int opt;
+    while((opt = getopt(argc, argv, "p:t:s:f:i:")) != -1) {
+        switch(opt) {
+        case 'p':
+            profile = optarg;
+            break;
+        case 't':
+            g_num_threads = (unsigned int)atoi(optarg);
+            break;
+        case 's':
+            g_num_surfaces = (unsigned int)atoi(optarg);
+            break;
+        case 'f':
+            g_num_frames = (unsigned int)atoi(optarg);
+            break;
+        case 'i':
+            g_swap_interval = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-p profile] [-t threads] [-s surfaces per thread] [-f frames] [-i swap interval]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(g_num_threads == 0 || g_num_surfaces == 0 || g_num_surfaces > MAX_SURFACES || g_num_frames == 0) {
+        fprintf(stderr, "Invalid thread, surface or frame count\n");
+        return 1;
+    }
+
+    // Both are read when the driver is loaded, at the first EGL call.
+    setenv("EGL_TO_WRAP", STUB_EGL_PATH, 0);
+    if(profile != NULL) {
+        setenv("STUB_EGL_PROFILE", profile, 1);
+    }
+
+    EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor;
+    if(!eglInitialize(dpy, &major, &minor)) {
+        fprintf(stderr, "eglInitialize failed\n");
+        return 1;
+    }
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if(!eglChooseConfig(dpy, g_config_attribs, &config, 1, &num_configs) || num_configs == 0) {
+        fprintf(stderr, "No EGL config\n");
+        return 1;
+    }
+    eglBindAPI(EGL_OPENGL_ES_API);
+
+    printf("%u thread(s), %u surface(s) each, %u frames, swap interval %d, profile %s\n",
+        g_num_threads, g_num_surfaces, g_num_frames, g_swap_interval,
+        profile != NULL ? profile : "none");
+
+    render_thread* threads = calloc(g_num_threads, sizeof(*threads));
+    uint64_t start = now_ns();
+    for(unsigned int i = 0; i < g_num_threads; i++) {
+        threads[i].index = i;
+        threads[i].frame_ns = calloc(g_num_frames, sizeof(uint64_t));
+        pthread_create(&threads[i].thread, NULL, render_thread_main, &threads[i]);
+    }
+    for(unsigned int i = 0; i < g_num_threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    double seconds = (now_ns() - start) / 1e9;
+
+    size_t num_samples = (size_t)g_num_threads * g_num_frames;
+    uint64_t* samples = malloc(num_samples * sizeof(uint64_t));
+    unsigned int failed_frames = 0, lost_contexts = 0;
+    bool init_failed = false;
+    for(unsigned int i = 0; i < g_num_threads; i++) {
+        init_failed |= threads[i].init_failed;
+        failed_frames += threads[i].failed_frames;
+        lost_contexts += threads[i].lost_contexts;
+        memcpy(&samples[(size_t)i * g_num_frames], threads[i].frame_ns, g_num_frames * sizeof(uint64_t));
+        free(threads[i].frame_ns);
+    }
+    qsort(samples, num_samples, sizeof(uint64_t), compare_u64);
+
+    printf("Throughput: %.1f surface frames/s (%.1f frames/s per thread)\n",
+        (double)num_samples * g_num_surfaces / seconds, g_num_frames / seconds);
+    printf("Frame time (all surfaces of a thread): p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+        percentile_ms(samples, num_samples, 50), percentile_ms(samples, num_samples, 90),
+        percentile_ms(samples, num_samples, 99), samples[num_samples - 1] / 1e6);
+    if(failed_frames != 0) {
+        printf("Failed surface frames: %u (%u lost context(s))\n", failed_frames, lost_contexts);
+    }
+    free(samples);
+    free(threads);
+    if(init_failed) {
+        return 1;
+    }
+
+    // Wrapper overhead: the same surface frame through the wrapper and
+    // straight to the driver, without the simulated latencies.
+    if(strchr(getenv("EGL_TO_WRAP"), ':') != NULL) {
+        printf("Wrapper overhead: not measured (several drivers wrapped)\n");
+        return 0;
+    }
+    void* driver = dlopen(getenv("EGL_TO_WRAP"), RTLD_LAZY | RTLD_NOLOAD);
+    void (*set_latency_enabled)(bool) =
+        driver != NULL ? (void (*)(bool))dlsym(driver, "stub_egl_set_latency_enabled") : NULL;
+    if(set_latency_enabled == NULL) {
+        printf("Wrapper overhead: not measured (not running on the stub driver)\n");
+        return 0;
+    }
+    if(getenv("EGL_WRAPPER_INJECT_RULES") != NULL) {
+        printf("Wrapper overhead: not measured (injection rules loaded)\n");
+        return 0;
+    }
+    frame_calls direct_calls = {
+        (EGLBoolean (*)(EGLDisplay, EGLSurface, EGLSurface, EGLContext))dlsym(driver, "eglMakeCurrent"),
+        (EGLBoolean (*)(EGLDisplay, EGLSurface, EGLint, EGLint *))dlsym(driver, "eglQuerySurface"),
+        (EGLBoolean (*)(EGLDisplay, EGLSurface))dlsym(driver, "eglSwapBuffers"),
+        (EGLint (*)(void))dlsym(driver, "eglGetError")
+    };
+    set_latency_enabled(false);
+    double direct_ns = measure_frame_cpu_ns(&direct_calls, dpy, config);
+    double wrapped_ns = measure_frame_cpu_ns(&g_wrapped_calls, dpy, config);
+    set_latency_enabled(true);
+    printf("Wrapper overhead: %.1f ns per surface frame (%.1f ns direct, %.1f ns wrapped)\n",
+        wrapped_ns - direct_ns, direct_ns, wrapped_ns);
+
+    eglTerminate(dpy);
+    return 0;
+}
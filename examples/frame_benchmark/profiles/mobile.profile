@@ -0,0 +1,12 @@
+# A slow mobile driver: expensive context and surface creation, costly
+# eglMakeCurrent, a GPU which takes most of a 60 Hz frame, and vsync.
+# Times in microseconds.
+call_us = 2
+query_us = 15
+make_current_us = 120
+create_context_us = 40000
+create_surface_us = 8000
+swap_us = 900
+gpu_us = 12000
+max_queued_frames = 2
+vsync_hz = 60
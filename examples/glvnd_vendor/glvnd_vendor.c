@@ -0,0 +1,43 @@
+// This example compiles a library which libglvnd loads as an EGL vendor,
+// in place of the real vendor library. Hooks then sit right behind
+// libglvnd's dispatch, instead of in front of it.
+//
+// The build also generates glvnd_vendor.json, which points libglvnd to the
+// library. To try it, e.g. with Mesa as the real vendor, run es2gears_x11
+// with __EGL_VENDOR_LIBRARY_FILENAMES=/path/to/glvnd_vendor.json and
+// EGL_WRAPPER_GLVND_VENDOR=libEGL_mesa.so.0.
+//
+// Each EGL call made through the wrapper is counted, and the counts are
+// printed at every eglInitialize and eglSwapBuffers.
+
+#include <egl-wrapper.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+static unsigned long g_initializes = 0;
+static unsigned long g_swaps = 0;
+
+static EGLBoolean my_eglInitialize(EGLDisplay dpy, EGLint* major, EGLint* minor) {
+    EGLBoolean result = bare_eglInitialize(dpy, major, minor);
+    printf("eglInitialize through the GLVND vendor wrapper (%lu)\n", ++g_initializes);
+    return result;
+}
+
+static EGLBoolean my_eglSwapBuffers(EGLDisplay dpy, EGLSurface surface) {
+    if(++g_swaps % 100 == 0) {
+        printf("%lu frames swapped through the GLVND vendor wrapper\n", g_swaps);
+    }
+    return bare_eglSwapBuffers(dpy, surface);
+}
+
+void egl_wrapper_first_contact(const char* egl_fn_name) {
+    static bool registered = false;
+
+    if(!registered) {
+        // The path is ignored in vendor mode, see egl-wrapper-glvnd.c.
+        egl_wrapper_initialize(NULL);
+        register_hook_eglInitialize(my_eglInitialize);
+        register_hook_eglSwapBuffers(my_eglSwapBuffers);
+        registered = true;
+    }
+}
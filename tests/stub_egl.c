@@ -0,0 +1,658 @@
+// A minimal, deterministic EGL implementation for the tests. Calls do no
+// work and take no time, except for the GPU, which is scripted per
+// surface by the test (stub_egl_set_gpu_time).
+//
+// Each surface has its own GPU queue: each frame adds the surface's GPU
+// time of work, which runs after the surface's previous frame. An
+// EGL_KHR_fence_sync fence signals when the frame it was inserted in is
+// done.
+//
+// Built with STUB_LATENCY_PROFILE, it is the stub driver of the
+// frame_benchmark example instead: calls take the time given by a profile
+// file, named by the STUB_EGL_PROFILE environment variable. Each line of
+// the profile is "key = value"; '#' starts a comment. Keys (times in
+// microseconds):
+//
+// call_us              any call not listed below
+// query_us             eglQuerySurface, eglGetConfigAttrib, eglQueryContext, eglQueryString
+// make_current_us      eglMakeCurrent
+// create_context_us    eglCreateContext
+// create_surface_us    eglCreate*Surface
+// swap_us              CPU time of eglSwapBuffers
+// gpu_us               GPU time of a frame, see below
+// max_queued_frames    frames the GPU may lag behind before eglSwapBuffers blocks
+// vsync_hz             with a swap interval of 1 or more, eglSwapBuffers
+//                      returns on the next vsync (0 for no vsync)
+//
+// All surfaces then share one GPU queue, to which each frame adds gpu_us
+// of work.
+
+#define _GNU_SOURCE
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+// Types
+typedef struct stub_surface {
+    EGLint width;
+    EGLint height;
+    EGLint swap_interval;
+    uint64_t gpu_ns;
+    uint64_t gpu_busy_until_ns;
+    struct stub_surface* next_free;
+} stub_surface;
+
+typedef struct {
+    uint64_t done_ns;
+} stub_fence;
+
+#ifdef STUB_LATENCY_PROFILE
+typedef struct {
+    uint64_t call_ns;
+    uint64_t query_ns;
+    uint64_t make_current_ns;
+    uint64_t create_context_ns;
+    uint64_t create_surface_ns;
+    uint64_t swap_ns;
+    uint64_t gpu_ns;
+    unsigned int max_queued_frames;
+    uint64_t vsync_period_ns;
+} latency_profile;
+#endif
+
+// Globals
+
+#ifdef STUB_SHARED_DISPLAY
+// Every copy of the stub built this way hands out the same display
+// handle, like unrelated drivers may.
+#define STUB_DISPLAY ((EGLDisplay)0x1)
+#else
+// Each copy of the stub hands out its own display handle.
+static char g_display_tag;
+#define STUB_DISPLAY ((EGLDisplay)&g_display_tag)
+#endif
+#define STUB_CONFIG ((EGLConfig)0x1)
+
+static pthread_mutex_t g_gpu_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int g_fences_created = 0;
+static unsigned int g_swaps = 0;
+static unsigned int g_flushes = 0;
+// Destroyed surfaces, reused first: drivers may hand out the handle of a
+// destroyed surface again.
+static stub_surface* g_free_surfaces = NULL;
+
+static __thread EGLint t_error = EGL_SUCCESS;
+static __thread EGLenum t_api = EGL_OPENGL_ES_API;
+static __thread EGLDisplay t_display = EGL_NO_DISPLAY;
+static __thread EGLSurface t_draw = EGL_NO_SURFACE;
+static __thread EGLSurface t_read = EGL_NO_SURFACE;
+static __thread EGLContext t_context = EGL_NO_CONTEXT;
+// Whether the GPU work of the current frame was already queued (by a
+// fence), and when it will be done.
+static __thread bool t_frame_queued = false;
+static __thread uint64_t t_frame_done_ns = 0;
+
+#ifdef STUB_LATENCY_PROFILE
+static latency_profile g_profile = {
+    .max_queued_frames = 2
+};
+static bool g_latency_enabled = true;
+static uint64_t g_start_ns = 0;
+static uint64_t g_gpu_busy_until_ns = 0;
+#define DELAY(key) delay(g_profile.key)
+#else
+#define DELAY(key) ((void)0)
+#endif
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline_ns) {
+    struct timespec ts = {
+        .tv_sec = (time_t)(deadline_ns / 1000000000ull),
+        .tv_nsec = (long)(deadline_ns % 1000000000ull)
+    };
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {}
+}
+
+#ifdef STUB_LATENCY_PROFILE
+// Short delays are spun, as sleeping would overshoot them by far.
+static void delay(uint64_t ns) {
+    if(!g_latency_enabled || ns == 0) {
+        return;
+    }
+    uint64_t deadline = now_ns() + ns;
+    if(ns >= 200000) {
+        sleep_until(deadline);
+        return;
+    }
+    while(now_ns() < deadline) {}
+}
+
+static void load_profile(const char* path) {
+    FILE* file = fopen(path, "r");
+    if(file == NULL) {
+        fprintf(stderr, "Failed to open stub EGL profile %s\n", path);
+        return;
+    }
+    char line[256];
+    while(fgets(line, sizeof(line), file) != NULL) {
+        char* comment = strchr(line, '#');
+        if(comment != NULL) {
+            *comment = '\0';
+        }
+        char key[64];
+        double value;
+        if(sscanf(line, " %63[a-z_] = %lf", key, &value) != 2) {
+            continue;
+        }
+        uint64_t ns = (uint64_t)(value * 1000.0);
+        if(strcmp(key, "call_us") == 0) {
+            g_profile.call_ns = ns;
+        } else if(strcmp(key, "query_us") == 0) {
+            g_profile.query_ns = ns;
+        } else if(strcmp(key, "make_current_us") == 0) {
+            g_profile.make_current_ns = ns;
+        } else if(strcmp(key, "create_context_us") == 0) {
+            g_profile.create_context_ns = ns;
+        } else if(strcmp(key, "create_surface_us") == 0) {
+            g_profile.create_surface_ns = ns;
+        } else if(strcmp(key, "swap_us") == 0) {
+            g_profile.swap_ns = ns;
+        } else if(strcmp(key, "gpu_us") == 0) {
+            g_profile.gpu_ns = ns;
+        } else if(strcmp(key, "max_queued_frames") == 0) {
+            g_profile.max_queued_frames = (unsigned int)value;
+        } else if(strcmp(key, "vsync_hz") == 0) {
+            g_profile.vsync_period_ns = value > 0.0 ? (uint64_t)(1e9 / value) : 0;
+        } else {
+            fprintf(stderr, "Unknown stub EGL profile key: %s\n", key);
+        }
+    }
+    fclose(file);
+}
+
+static void __attribute__((constructor)) stub_init(void) {
+    g_start_ns = now_ns();
+    const char* profile = getenv("STUB_EGL_PROFILE");
+    if(profile != NULL) {
+        load_profile(profile);
+    }
+}
+
+// Lets the benchmark measure overhead without the simulated latencies.
+void stub_egl_set_latency_enabled(bool enabled) {
+    g_latency_enabled = enabled;
+}
+#endif
+
+static EGLBoolean fail(EGLint error) {
+    t_error = error;
+    return EGL_FALSE;
+}
+
+static EGLBoolean succeed(void) {
+    t_error = EGL_SUCCESS;
+    return EGL_TRUE;
+}
+
+// Sets the GPU time of each following frame of a surface.
+void stub_egl_set_gpu_time(EGLSurface surface, uint64_t gpu_ns) {
+    pthread_mutex_lock(&g_gpu_lock);
+    ((stub_surface*)surface)->gpu_ns = gpu_ns;
+    pthread_mutex_unlock(&g_gpu_lock);
+}
+
+// Number of fences created through this copy of the stub.
+unsigned int stub_egl_fences_created(void) {
+    pthread_mutex_lock(&g_gpu_lock);
+    unsigned int count = g_fences_created;
+    pthread_mutex_unlock(&g_gpu_lock);
+    return count;
+}
+
+// Number of swaps and glFlush calls which reached this copy of the stub.
+unsigned int stub_egl_swaps(void) {
+    pthread_mutex_lock(&g_gpu_lock);
+    unsigned int count = g_swaps;
+    pthread_mutex_unlock(&g_gpu_lock);
+    return count;
+}
+
+unsigned int stub_egl_flushes(void) {
+    pthread_mutex_lock(&g_gpu_lock);
+    unsigned int count = g_flushes;
+    pthread_mutex_unlock(&g_gpu_lock);
+    return count;
+}
+
+// Queue the GPU work of the current frame. Returns when it will be done.
+static uint64_t queue_frame(void) {
+    t_frame_queued = true;
+#ifdef STUB_LATENCY_PROFILE
+    uint64_t* busy_until_ns = &g_gpu_busy_until_ns;
+    uint64_t gpu_ns = g_profile.gpu_ns;
+#else
+    stub_surface* s = t_draw;
+    if(s == NULL) {
+        t_frame_done_ns = now_ns();
+        return t_frame_done_ns;
+    }
+    uint64_t* busy_until_ns = &s->gpu_busy_until_ns;
+    uint64_t gpu_ns = s->gpu_ns;
+#endif
+    pthread_mutex_lock(&g_gpu_lock);
+    uint64_t now = now_ns();
+#ifdef STUB_LATENCY_PROFILE
+    if(!g_latency_enabled) {
+        *busy_until_ns = now;
+        gpu_ns = 0;
+    }
+#endif
+    *busy_until_ns = (*busy_until_ns > now ? *busy_until_ns : now) + gpu_ns;
+    uint64_t done = *busy_until_ns;
+    pthread_mutex_unlock(&g_gpu_lock);
+    t_frame_done_ns = done;
+    return done;
+}
+
+EGLint eglGetError(void) {
+    EGLint error = t_error;
+    t_error = EGL_SUCCESS;
+    return error;
+}
+
+EGLDisplay eglGetDisplay(EGLNativeDisplayType display_id) {
+    (void)display_id;
+    DELAY(call_ns);
+    return STUB_DISPLAY;
+}
+
+EGLBoolean eglInitialize(EGLDisplay dpy, EGLint *major, EGLint *minor) {
+    DELAY(call_ns);
+    if(dpy != STUB_DISPLAY) {
+        return fail(EGL_BAD_DISPLAY);
+    }
+    if(major != NULL) {
+        *major = 1;
+    }
+    if(minor != NULL) {
+        *minor = 4;
+    }
+    return succeed();
+}
+
+EGLBoolean eglTerminate(EGLDisplay dpy) {
+    DELAY(call_ns);
+    return dpy == STUB_DISPLAY ? succeed() : fail(EGL_BAD_DISPLAY);
+}
+
+const char *eglQueryString(EGLDisplay dpy, EGLint name) {
+    DELAY(query_ns);
+    switch(name) {
+    case EGL_VENDOR:
+        return "egl-wrapper stub";
+    case EGL_VERSION:
+        return "1.4 stub";
+    case EGL_EXTENSIONS:
+        return dpy == STUB_DISPLAY ? "EGL_KHR_fence_sync" : "";
+    case EGL_CLIENT_APIS:
+        return "OpenGL_ES";
+    }
+    fail(EGL_BAD_PARAMETER);
+    return NULL;
+}
+
+EGLBoolean eglGetConfigs(EGLDisplay dpy, EGLConfig *configs, EGLint config_size, EGLint *num_config) {
+    DELAY(query_ns);
+    if(configs != NULL && config_size > 0) {
+        configs[0] = STUB_CONFIG;
+    }
+    *num_config = 1;
+    return dpy == STUB_DISPLAY ? succeed() : fail(EGL_BAD_DISPLAY);
+}
+
+EGLBoolean eglChooseConfig(EGLDisplay dpy, const EGLint *attrib_list, EGLConfig *configs, EGLint config_size, EGLint *num_config) {
+    (void)attrib_list;
+    return eglGetConfigs(dpy, configs, config_size, num_config);
+}
+
+EGLBoolean eglGetConfigAttrib(EGLDisplay dpy, EGLConfig config, EGLint attribute, EGLint *value) {
+    (void)dpy;
+    (void)config;
+    DELAY(query_ns);
+    switch(attribute) {
+    case EGL_RED_SIZE:
+    case EGL_GREEN_SIZE:
+    case EGL_BLUE_SIZE:
+    case EGL_ALPHA_SIZE:
+        *value = 8;
+        break;
+    case EGL_SURFACE_TYPE:
+        *value = EGL_WINDOW_BIT | EGL_PBUFFER_BIT;
+        break;
+    default:
+        *value = 0;
+    }
+    return succeed();
+}
+
+static EGLSurface create_surface(EGLDisplay dpy, const EGLint *attrib_list) {
+    DELAY(create_surface_ns);
+    if(dpy != STUB_DISPLAY) {
+        fail(EGL_BAD_DISPLAY);
+        return EGL_NO_SURFACE;
+    }
+    pthread_mutex_lock(&g_gpu_lock);
+    stub_surface* surface = g_free_surfaces;
+    if(surface != NULL) {
+        g_free_surfaces = surface->next_free;
+    }
+    pthread_mutex_unlock(&g_gpu_lock);
+    if(surface == NULL) {
+        surface = malloc(sizeof(*surface));
+    }
+    memset(surface, 0, sizeof(*surface));
+    surface->width = 64;
+    surface->height = 64;
+    surface->swap_interval = 1;
+    for(const EGLint* attrib = attrib_list; attrib != NULL && attrib[0] != EGL_NONE; attrib += 2) {
+        if(attrib[0] == EGL_WIDTH) {
+            surface->width = attrib[1];
+        } else if(attrib[0] == EGL_HEIGHT) {
+            surface->height = attrib[1];
+        }
+    }
+    succeed();
+    return surface;
+}
+
+EGLSurface eglCreateWindowSurface(EGLDisplay dpy, EGLConfig config, EGLNativeWindowType win, const EGLint *attrib_list) {
+    (void)config;
+    (void)win;
+    return create_surface(dpy, attrib_list);
+}
+
+EGLSurface eglCreatePbufferSurface(EGLDisplay dpy, EGLConfig config, const EGLint *attrib_list) {
+    (void)config;
+    return create_surface(dpy, attrib_list);
+}
+
+EGLSurface eglCreatePixmapSurface(EGLDisplay dpy, EGLConfig config, EGLNativePixmapType pixmap, const EGLint *attrib_list) {
+    (void)config;
+    (void)pixmap;
+    return create_surface(dpy, attrib_list);
+}
+
+EGLSurface eglCreatePbufferFromClientBuffer(EGLDisplay dpy, EGLenum buftype, EGLClientBuffer buffer, EGLConfig config, const EGLint *attrib_list) {
+    (void)buftype;
+    (void)buffer;
+    (void)config;
+    return create_surface(dpy, attrib_list);
+}
+
+EGLBoolean eglDestroySurface(EGLDisplay dpy, EGLSurface surface) {
+    (void)dpy;
+    DELAY(call_ns);
+    stub_surface* s = surface;
+    if(s == NULL) {
+        return fail(EGL_BAD_SURFACE);
+    }
+    pthread_mutex_lock(&g_gpu_lock);
+    s->next_free = g_free_surfaces;
+    g_free_surfaces = s;
+    pthread_mutex_unlock(&g_gpu_lock);
+    return succeed();
+}
+
+EGLBoolean eglQuerySurface(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint *value) {
+    (void)dpy;
+    DELAY(query_ns);
+    stub_surface* s = surface;
+    if(s == NULL) {
+        return fail(EGL_BAD_SURFACE);
+    }
+    switch(attribute) {
+    case EGL_WIDTH:
+        *value = s->width;
+        break;
+    case EGL_HEIGHT:
+        *value = s->height;
+        break;
+    default:
+        return fail(EGL_BAD_ATTRIBUTE);
+    }
+    return succeed();
+}
+
+EGLBoolean eglBindAPI(EGLenum api) {
+    DELAY(call_ns);
+    t_api = api;
+    return succeed();
+}
+
+EGLenum eglQueryAPI(void) {
+    return t_api;
+}
+
+EGLBoolean eglWaitClient(void) {
+    DELAY(call_ns);
+    return succeed();
+}
+
+EGLBoolean eglReleaseThread(void) {
+    DELAY(call_ns);
+    t_display = EGL_NO_DISPLAY;
+    t_draw = t_read = EGL_NO_SURFACE;
+    t_context = EGL_NO_CONTEXT;
+    return succeed();
+}
+
+EGLBoolean eglSurfaceAttrib(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint value) {
+    (void)dpy;
+    (void)surface;
+    (void)attribute;
+    (void)value;
+    DELAY(call_ns);
+    return succeed();
+}
+
+EGLBoolean eglBindTexImage(EGLDisplay dpy, EGLSurface surface, EGLint buffer) {
+    (void)dpy;
+    (void)surface;
+    (void)buffer;
+    DELAY(call_ns);
+    return succeed();
+}
+
+EGLBoolean eglReleaseTexImage(EGLDisplay dpy, EGLSurface surface, EGLint buffer) {
+    (void)dpy;
+    (void)surface;
+    (void)buffer;
+    DELAY(call_ns);
+    return succeed();
+}
+
+EGLBoolean eglSwapInterval(EGLDisplay dpy, EGLint interval) {
+    (void)dpy;
+    DELAY(call_ns);
+    if(t_draw == EGL_NO_SURFACE) {
+        return fail(EGL_BAD_SURFACE);
+    }
+    ((stub_surface*)t_draw)->swap_interval = interval;
+    return succeed();
+}
+
+EGLContext eglCreateContext(EGLDisplay dpy, EGLConfig config, EGLContext share_context, const EGLint *attrib_list) {
+    (void)config;
+    (void)share_context;
+    (void)attrib_list;
+    DELAY(create_context_ns);
+    if(dpy != STUB_DISPLAY) {
+        fail(EGL_BAD_DISPLAY);
+        return EGL_NO_CONTEXT;
+    }
+    succeed();
+    return malloc(1);
+}
+
+EGLBoolean eglDestroyContext(EGLDisplay dpy, EGLContext ctx) {
+    (void)dpy;
+    DELAY(call_ns);
+    free(ctx);
+    return succeed();
+}
+
+EGLBoolean eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx) {
+    DELAY(make_current_ns);
+    t_display = ctx != EGL_NO_CONTEXT ? dpy : EGL_NO_DISPLAY;
+    t_draw = draw;
+    t_read = read;
+    t_context = ctx;
+    return succeed();
+}
+
+// Like those of some drivers, the getters succeed, so they clear the error.
+EGLContext eglGetCurrentContext(void) {
+    succeed();
+    return t_context;
+}
+
+EGLSurface eglGetCurrentSurface(EGLint readdraw) {
+    succeed();
+    return readdraw == EGL_READ ? t_read : t_draw;
+}
+
+EGLDisplay eglGetCurrentDisplay(void) {
+    succeed();
+    return t_display;
+}
+
+EGLBoolean eglQueryContext(EGLDisplay dpy, EGLContext ctx, EGLint attribute, EGLint *value) {
+    (void)dpy;
+    (void)ctx;
+    DELAY(query_ns);
+    *value = attribute == EGL_CONTEXT_CLIENT_VERSION ? 2 : 0;
+    return succeed();
+}
+
+EGLBoolean eglWaitGL(void) {
+    DELAY(call_ns);
+    return succeed();
+}
+
+EGLBoolean eglWaitNative(EGLint engine) {
+    (void)engine;
+    DELAY(call_ns);
+    return succeed();
+}
+
+EGLBoolean eglSwapBuffers(EGLDisplay dpy, EGLSurface surface) {
+    if(dpy != STUB_DISPLAY) {
+        return fail(EGL_BAD_DISPLAY);
+    }
+    stub_surface* s = surface;
+    if(s == NULL) {
+        return fail(EGL_BAD_SURFACE);
+    }
+    DELAY(swap_ns);
+    uint64_t gpu_done = t_frame_queued ? t_frame_done_ns : queue_frame();
+    t_frame_queued = false;
+    pthread_mutex_lock(&g_gpu_lock);
+    g_swaps++;
+    pthread_mutex_unlock(&g_gpu_lock);
+
+#ifdef STUB_LATENCY_PROFILE
+    if(g_latency_enabled) {
+        // Block while the GPU lags too far behind.
+        uint64_t max_lag = (uint64_t)g_profile.max_queued_frames * g_profile.gpu_ns;
+        if(gpu_done > now_ns() + max_lag) {
+            sleep_until(gpu_done - max_lag);
+        }
+        if(g_profile.vsync_period_ns > 0 && s->swap_interval > 0) {
+            uint64_t period = g_profile.vsync_period_ns * (uint64_t)s->swap_interval;
+            uint64_t since_start = now_ns() - g_start_ns;
+            sleep_until(g_start_ns + (since_start / period + 1) * period);
+        }
+    }
+#else
+    (void)gpu_done;
+#endif
+    return succeed();
+}
+
+EGLBoolean eglCopyBuffers(EGLDisplay dpy, EGLSurface surface, EGLNativePixmapType target) {
+    (void)dpy;
+    (void)surface;
+    (void)target;
+    DELAY(call_ns);
+    return succeed();
+}
+
+static EGLSyncKHR stub_eglCreateSyncKHR(EGLDisplay dpy, EGLenum type, const EGLint *attrib_list) {
+    (void)type;
+    (void)attrib_list;
+    if(dpy != STUB_DISPLAY || t_context == EGL_NO_CONTEXT) {
+        fail(EGL_BAD_MATCH);
+        return EGL_NO_SYNC_KHR;
+    }
+    stub_fence* fence = malloc(sizeof(*fence));
+    fence->done_ns = queue_frame();
+    pthread_mutex_lock(&g_gpu_lock);
+    g_fences_created++;
+    pthread_mutex_unlock(&g_gpu_lock);
+    return fence;
+}
+
+static EGLBoolean stub_eglDestroySyncKHR(EGLDisplay dpy, EGLSyncKHR sync) {
+    (void)dpy;
+    free(sync);
+    return EGL_TRUE;
+}
+
+static EGLint stub_eglClientWaitSyncKHR(EGLDisplay dpy, EGLSyncKHR sync, EGLint flags, EGLTimeKHR timeout) {
+    (void)dpy;
+    (void)flags;
+    uint64_t done = ((stub_fence*)sync)->done_ns;
+    uint64_t now = now_ns();
+    if(now >= done) {
+        return EGL_CONDITION_SATISFIED_KHR;
+    }
+    if(timeout != EGL_FOREVER_KHR && now + timeout < done) {
+        if(timeout > 0) {
+            sleep_until(now + timeout);
+        }
+        return EGL_TIMEOUT_EXPIRED_KHR;
+    }
+    sleep_until(done);
+    return EGL_CONDITION_SATISFIED_KHR;
+}
+
+static void stub_glFlush(void) {
+    pthread_mutex_lock(&g_gpu_lock);
+    g_flushes++;
+    pthread_mutex_unlock(&g_gpu_lock);
+}
+
+__eglMustCastToProperFunctionPointerType eglGetProcAddress(const char *procname) {
+    if(strcmp(procname, "glFlush") == 0) {
+        return (__eglMustCastToProperFunctionPointerType)stub_glFlush;
+    } else if(strcmp(procname, "eglCreateSyncKHR") == 0) {
+        return (__eglMustCastToProperFunctionPointerType)stub_eglCreateSyncKHR;
+    } else if(strcmp(procname, "eglDestroySyncKHR") == 0) {
+        return (__eglMustCastToProperFunctionPointerType)stub_eglDestroySyncKHR;
+    } else if(strcmp(procname, "eglClientWaitSyncKHR") == 0) {
+        return (__eglMustCastToProperFunctionPointerType)stub_eglClientWaitSyncKHR;
+    }
+    return NULL;
+}
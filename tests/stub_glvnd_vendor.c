@@ -0,0 +1,36 @@
+// Turns the stub EGL into a libglvnd vendor library, for test_glvnd: its
+// __egl_Main only hands out its functions through getProcAddress.
+
+#define _GNU_SOURCE
+
+#include <glvnd/libeglabi.h>
+#include <dlfcn.h>
+#include <string.h>
+
+// Globals
+static void* g_handle = NULL;
+static unsigned int g_main_calls = 0;
+
+unsigned int stub_glvnd_main_calls(void) {
+    return g_main_calls;
+}
+
+static void* stub_get_proc_address(const char* name) {
+    return dlsym(g_handle, name);
+}
+
+EGLBoolean __egl_Main(uint32_t version, const __EGLapiExports* exports,
+    __EGLvendorInfo* vendor, __EGLapiImports* imports) {
+    (void)exports;
+    (void)vendor;
+    Dl_info info;
+    if(EGL_VENDOR_ABI_GET_MAJOR_VERSION(version) != EGL_VENDOR_ABI_MAJOR_VERSION ||
+        dladdr((void*)stub_get_proc_address, &info) == 0 ||
+        (g_handle = dlopen(info.dli_fname, RTLD_LAZY | RTLD_NOLOAD)) == NULL) {
+        return EGL_FALSE;
+    }
+    memset(imports, 0, sizeof(*imports));
+    imports->getProcAddress = stub_get_proc_address;
+    g_main_calls++;
+    return EGL_TRUE;
+}
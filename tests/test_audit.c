@@ -0,0 +1,41 @@
+// rtld-audit module: an application linked to the stub EGL runs with the
+// wrapper preloaded and LD_AUDIT set (see tests/CMakeLists.txt), with the
+// stub named by its file name in EGL_TO_WRAP. The unhooked calls must go
+// straight to the stub, and eglSwapBuffers through the wrapper.
+//
+// This program is not linked to egl-wrapper, so it has its own CHECK.
+
+#define _GNU_SOURCE
+
+#include <EGL/egl.h>
+#include <dlfcn.h>
+#include <stdio.h>
+
+// Globals
+static int g_test_failures = 0;
+
+#define CHECK(condition) do { \
+    if(!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        g_test_failures++; \
+    } \
+} while(0)
+
+int main(void) {
+    unsigned int (*first_contacts)(void) = (unsigned int (*)(void))dlsym(RTLD_DEFAULT, "test_audit_first_contacts");
+    unsigned int (*hooked_swaps)(void) = (unsigned int (*)(void))dlsym(RTLD_DEFAULT, "test_audit_hooked_swaps");
+    if(first_contacts == NULL || hooked_swaps == NULL) {
+        fprintf(stderr, "The hooks library is not preloaded\n");
+        return 1;
+    }
+
+    // Would initialize the wrapper if they went through it.
+    CHECK(eglQueryAPI() == EGL_OPENGL_ES_API);
+    CHECK(eglGetError() == EGL_SUCCESS);
+    CHECK(first_contacts() == 0);
+
+    eglSwapBuffers(EGL_NO_DISPLAY, EGL_NO_SURFACE);
+    CHECK(first_contacts() == 1);
+    CHECK(hooked_swaps() == 1);
+    return g_test_failures == 0 ? 0 : 1;
+}
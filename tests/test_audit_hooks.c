@@ -0,0 +1,33 @@
+// The hooks library preloaded by test_audit, next to egl-wrapper. It hooks
+// eglSwapBuffers only, and counts what reaches the wrapper.
+
+#include "egl-wrapper.h"
+
+#include <stddef.h>
+
+// Globals
+static unsigned int g_first_contacts = 0;
+static unsigned int g_hooked_swaps = 0;
+
+unsigned int test_audit_first_contacts(void) {
+    return g_first_contacts;
+}
+
+unsigned int test_audit_hooked_swaps(void) {
+    return g_hooked_swaps;
+}
+
+static EGLBoolean hooked_swap_buffers(EGLDisplay dpy, EGLSurface surface) {
+    g_hooked_swaps++;
+    return bare_eglSwapBuffers(dpy, surface);
+}
+
+void egl_wrapper_first_contact(const char* egl_fn_name) {
+    (void)egl_fn_name;
+    g_first_contacts++;
+    egl_wrapper_initialize(NULL);
+}
+
+static void __attribute__((constructor)) register_hooks(void) {
+    register_hook_eglSwapBuffers(hooked_swap_buffers);
+}
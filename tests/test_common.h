@@ -0,0 +1,65 @@
+// Helpers shared by the tests. Each test is a program linked to
+// egl-wrapper, which wraps the stub EGL of tests/stub_egl.c (its path is
+// given by STUB_EGL_PATH), and exits with a non-zero status on failure.
+
+#ifndef EGL_WRAPPER_TEST_COMMON_H
+#define EGL_WRAPPER_TEST_COMMON_H
+
+#define _GNU_SOURCE
+
+#include "egl-wrapper.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include <time.h>
+
+static int g_test_failures = 0;
+
+#define CHECK(condition) do { \
+    if(!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        g_test_failures++; \
+    } \
+} while(0)
+
+#define TEST_RESULT() (g_test_failures == 0 ? 0 : 1)
+
+// egl-wrapper calls this on the first call to a wrapped function.
+void egl_wrapper_first_contact(const char* egl_fn_name) {
+    (void)egl_fn_name;
+    egl_wrapper_initialize(NULL);
+}
+
+static inline uint64_t test_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void test_sleep_ns(uint64_t ns) {
+    struct timespec ts = {
+        .tv_sec = (time_t)(ns / 1000000000ull),
+        .tv_nsec = (long)(ns % 1000000000ull)
+    };
+    nanosleep(&ts, NULL);
+}
+
+// Looks up a function of an already loaded stub EGL library.
+static inline void* test_stub_symbol(const char* path, const char* name) {
+    void* library = dlopen(path, RTLD_NOW | RTLD_NOLOAD);
+    if(library == NULL) {
+        fprintf(stderr, "Stub EGL %s is not loaded\n", path);
+        exit(1);
+    }
+    void* symbol = dlsym(library, name);
+    dlclose(library);
+    if(symbol == NULL) {
+        fprintf(stderr, "Stub EGL %s has no %s\n", path, name);
+        exit(1);
+    }
+    return symbol;
+}
+
+#endif
@@ -0,0 +1,74 @@
+// Frame decimation: every Nth swap of a surface and at most a given rate
+// are presented, the other swaps are replaced by a glFlush. A destroyed
+// surface's count must not carry over to a new surface with its handle.
+
+#include "test_common.h"
+
+#include <EGL/egl.h>
+
+// Globals
+static unsigned int (*g_stub_swaps)(void);
+static unsigned int (*g_stub_flushes)(void);
+
+static void check_decimation_stats(unsigned long long presented, unsigned long long skipped) {
+    egl_wrapper_decimation_stats stats;
+    egl_wrapper_get_decimation_stats(&stats);
+    CHECK(stats.presented == presented);
+    CHECK(stats.skipped == skipped);
+}
+
+int main(void) {
+    egl_wrapper_initialize(STUB_EGL_PATH);
+    EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    CHECK(eglInitialize(dpy, NULL, NULL) == EGL_TRUE);
+    EGLConfig config;
+    EGLint num_config;
+    eglChooseConfig(dpy, NULL, &config, 1, &num_config);
+    g_stub_swaps = (unsigned int (*)(void))test_stub_symbol(STUB_EGL_PATH, "stub_egl_swaps");
+    g_stub_flushes = (unsigned int (*)(void))test_stub_symbol(STUB_EGL_PATH, "stub_egl_flushes");
+
+    EGLSurface surface = eglCreatePbufferSurface(dpy, config, NULL);
+    EGLContext ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, NULL);
+    eglMakeCurrent(dpy, surface, surface, ctx);
+
+    // Every 3rd swap, starting with the first.
+    egl_wrapper_set_frame_decimation(3, 0.0);
+    for(unsigned int i = 0; i < 9; i++) {
+        CHECK(eglSwapBuffers(dpy, surface) == EGL_TRUE);
+        CHECK(g_stub_swaps() == i / 3 + 1);
+    }
+    CHECK(g_stub_flushes() == 6);
+    check_decimation_stats(3, 6);
+
+    // At most 20 Hz: a swap right after a presented one is held back, and
+    // presented once the interval has passed.
+    egl_wrapper_set_frame_decimation(1, 20.0);
+    test_sleep_ns(60000000ull);
+    eglSwapBuffers(dpy, surface);
+    CHECK(g_stub_swaps() == 4);
+    eglSwapBuffers(dpy, surface);
+    CHECK(g_stub_swaps() == 4);
+    test_sleep_ns(60000000ull);
+    eglSwapBuffers(dpy, surface);
+    CHECK(g_stub_swaps() == 5);
+    CHECK(g_stub_flushes() == 7);
+    check_decimation_stats(5, 7);
+
+    // The stub hands out the destroyed surface's handle again, whose first
+    // frame must be presented.
+    egl_wrapper_set_frame_decimation(3, 0.0);
+    EGLSurface destroyed = eglCreatePbufferSurface(dpy, config, NULL);
+    eglSwapBuffers(dpy, destroyed);
+    eglSwapBuffers(dpy, destroyed);
+    CHECK(g_stub_swaps() == 6);
+    eglDestroySurface(dpy, destroyed);
+    EGLSurface reused = eglCreatePbufferSurface(dpy, config, NULL);
+    CHECK(reused == destroyed);
+    eglSwapBuffers(dpy, reused);
+    CHECK(g_stub_swaps() == 7);
+
+    egl_wrapper_set_frame_decimation(1, 0.0);
+    eglSwapBuffers(dpy, reused);
+    CHECK(g_stub_swaps() == 8);
+    return TEST_RESULT();
+}
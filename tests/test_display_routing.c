@@ -0,0 +1,78 @@
+// Routing with several wrapped libraries: two copies of the stub which
+// hand out the same display handle can't both be routed, so the second
+// eglGetDisplay must fail rather than take over the first one's display.
+// Extension functions from eglGetProcAddress must reach the library
+// owning the display they are called with. Making a context of another
+// library current releases the one of the previous library.
+
+#include "test_common.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#define WRAPPED_LIBRARIES STUB_EGL_PATH ":" STUB_SHARED_A_PATH ":" STUB_SHARED_B_PATH
+
+// Makes a context of dpy current, which the stub needs to create fences.
+static void make_current(EGLDisplay dpy) {
+    EGLConfig config;
+    EGLint num_config;
+    CHECK(eglChooseConfig(dpy, NULL, &config, 1, &num_config) == EGL_TRUE);
+    EGLSurface surface = eglCreatePbufferSurface(dpy, config, NULL);
+    EGLContext ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, NULL);
+    CHECK(surface != EGL_NO_SURFACE && ctx != EGL_NO_CONTEXT);
+    CHECK(eglMakeCurrent(dpy, surface, surface, ctx) == EGL_TRUE);
+}
+
+static unsigned int fences_created(const char* path) {
+    unsigned int (*count)(void) = (unsigned int (*)(void))test_stub_symbol(path, "stub_egl_fences_created");
+    return count();
+}
+
+int main(void) {
+    egl_wrapper_initialize(WRAPPED_LIBRARIES);
+    egl_wrapper_set_display_policy(EGL_WRAPPER_DISPLAY_POLICY_ROUND_ROBIN);
+
+    EGLDisplay distinct = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLDisplay shared = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    CHECK(distinct != EGL_NO_DISPLAY && shared != EGL_NO_DISPLAY && distinct != shared);
+    CHECK(egl_wrapper_display_library(distinct) == 0);
+    CHECK(egl_wrapper_display_library(shared) == 1);
+
+    // The third library returns the handle of the second one.
+    CHECK(eglGetDisplay(EGL_DEFAULT_DISPLAY) == EGL_NO_DISPLAY);
+    CHECK(eglGetError() == EGL_BAD_DISPLAY);
+    CHECK(egl_wrapper_display_library(shared) == 1);
+    CHECK(eglGetError() == EGL_SUCCESS);
+
+    CHECK(eglInitialize(distinct, NULL, NULL) == EGL_TRUE);
+    CHECK(eglInitialize(shared, NULL, NULL) == EGL_TRUE);
+
+    // Each copy of the stub has its own fence functions.
+    PFNEGLCREATESYNCKHRPROC create_sync = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+    PFNEGLDESTROYSYNCKHRPROC destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+    CHECK(create_sync != NULL && destroy_sync != NULL);
+    CHECK((PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR") == create_sync);
+
+    make_current(distinct);
+    EGLSyncKHR sync = create_sync(distinct, EGL_SYNC_FENCE_KHR, NULL);
+    CHECK(sync != EGL_NO_SYNC_KHR);
+    CHECK(destroy_sync(distinct, sync) == EGL_TRUE);
+    CHECK(fences_created(STUB_EGL_PATH) == 1);
+    CHECK(fences_created(STUB_SHARED_A_PATH) == 0);
+
+    EGLContext (*first_current_context)(void) =
+        (EGLContext (*)(void))test_stub_symbol(STUB_EGL_PATH, "eglGetCurrentContext");
+    CHECK(first_current_context() != EGL_NO_CONTEXT);
+    make_current(shared);
+    CHECK(first_current_context() == EGL_NO_CONTEXT);
+    sync = create_sync(shared, EGL_SYNC_FENCE_KHR, NULL);
+    CHECK(sync != EGL_NO_SYNC_KHR);
+    CHECK(destroy_sync(shared, sync) == EGL_TRUE);
+    CHECK(fences_created(STUB_EGL_PATH) == 1);
+    CHECK(fences_created(STUB_SHARED_A_PATH) == 1);
+    CHECK(fences_created(STUB_SHARED_B_PATH) == 0);
+
+    // Functions no library has are not routed.
+    CHECK(eglGetProcAddress("eglNoSuchFunctionEXT") == NULL);
+    return TEST_RESULT();
+}
@@ -0,0 +1,139 @@
+// Frames-in-flight limiter: a GPU-bound surface is throttled to the limit,
+// while a thread rendering to another surface at the same time is not
+// slowed down by it. Checked both with the render threads retiring the
+// fences themselves, and with GPU timing retiring them. Destroyed surfaces
+// with frames still in flight don't keep the limiter from working.
+
+#include "test_common.h"
+
+#include <EGL/egl.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+#define FRAMES 10
+#define MAX_FRAMES_IN_FLIGHT 2
+#define SLOW_GPU_NS 20000000ull
+#define FAST_GPU_NS 100000ull
+#define HUNG_GPU_NS 10000000000ull
+// More than the wrapper has fence queues for.
+#define DESTROYED_SURFACES 40
+
+// Types
+typedef struct {
+    uint64_t gpu_ns;
+    uint64_t elapsed_ns;    // time taken by all swaps
+} render_thread;
+
+// Globals
+static EGLDisplay g_dpy;
+static EGLConfig g_config;
+static pthread_barrier_t g_start;
+
+static void* render(void* arg) {
+    render_thread* thread = arg;
+    EGLSurface surface = eglCreatePbufferSurface(g_dpy, g_config, NULL);
+    EGLContext ctx = eglCreateContext(g_dpy, g_config, EGL_NO_CONTEXT, NULL);
+    void (*set_gpu_time)(EGLSurface, uint64_t) =
+        (void (*)(EGLSurface, uint64_t))test_stub_symbol(STUB_EGL_PATH, "stub_egl_set_gpu_time");
+    set_gpu_time(surface, thread->gpu_ns);
+    eglMakeCurrent(g_dpy, surface, surface, ctx);
+    pthread_barrier_wait(&g_start);
+
+    uint64_t start = test_now_ns();
+    for(unsigned int i = 0; i < FRAMES; i++) {
+        CHECK(eglSwapBuffers(g_dpy, surface) == EGL_TRUE);
+    }
+    thread->elapsed_ns = test_now_ns() - start;
+
+    eglMakeCurrent(g_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(g_dpy, ctx);
+    eglDestroySurface(g_dpy, surface);
+    return NULL;
+}
+
+static void run(void) {
+    render_thread threads[2] = {
+        { .gpu_ns = SLOW_GPU_NS },
+        { .gpu_ns = FAST_GPU_NS },
+    };
+    pthread_barrier_init(&g_start, NULL, 2);
+    pthread_t ids[2];
+    for(unsigned int i = 0; i < 2; i++) {
+        pthread_create(&ids[i], NULL, render, &threads[i]);
+    }
+    for(unsigned int i = 0; i < 2; i++) {
+        pthread_join(ids[i], NULL);
+    }
+    pthread_barrier_destroy(&g_start);
+
+    // The slow surface can only run MAX_FRAMES_IN_FLIGHT frames ahead of
+    // its GPU.
+    CHECK(threads[0].elapsed_ns + 2000000ull >= (FRAMES - MAX_FRAMES_IN_FLIGHT) * SLOW_GPU_NS);
+    // The fast surface only ever waits on its own (short) frames.
+    CHECK(threads[1].elapsed_ns < SLOW_GPU_NS);
+}
+
+// Leave a frame in flight on many surfaces and destroy them, then check
+// that a new surface is still throttled.
+static void run_destroyed_surfaces(void) {
+    void (*set_gpu_time)(EGLSurface, uint64_t) =
+        (void (*)(EGLSurface, uint64_t))test_stub_symbol(STUB_EGL_PATH, "stub_egl_set_gpu_time");
+    EGLContext ctx = eglCreateContext(g_dpy, g_config, EGL_NO_CONTEXT, NULL);
+    // All alive at once, as the stub reuses the handles of destroyed ones.
+    EGLSurface surfaces[DESTROYED_SURFACES];
+    for(unsigned int i = 0; i < DESTROYED_SURFACES; i++) {
+        surfaces[i] = eglCreatePbufferSurface(g_dpy, g_config, NULL);
+        set_gpu_time(surfaces[i], HUNG_GPU_NS);
+        eglMakeCurrent(g_dpy, surfaces[i], surfaces[i], ctx);
+        CHECK(eglSwapBuffers(g_dpy, surfaces[i]) == EGL_TRUE);
+    }
+    eglMakeCurrent(g_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    for(unsigned int i = 0; i < DESTROYED_SURFACES; i++) {
+        eglDestroySurface(g_dpy, surfaces[i]);
+    }
+
+    egl_wrapper_frame_limiter_stats before;
+    egl_wrapper_get_frame_limiter_stats(&before);
+    CHECK(before.frames_in_flight == 0);
+
+    EGLSurface surface = eglCreatePbufferSurface(g_dpy, g_config, NULL);
+    set_gpu_time(surface, SLOW_GPU_NS);
+    eglMakeCurrent(g_dpy, surface, surface, ctx);
+    uint64_t start = test_now_ns();
+    for(unsigned int i = 0; i < FRAMES; i++) {
+        CHECK(eglSwapBuffers(g_dpy, surface) == EGL_TRUE);
+    }
+    uint64_t elapsed = test_now_ns() - start;
+    CHECK(elapsed + 2000000ull >= (FRAMES - MAX_FRAMES_IN_FLIGHT) * SLOW_GPU_NS);
+
+    egl_wrapper_frame_limiter_stats after;
+    egl_wrapper_get_frame_limiter_stats(&after);
+    CHECK(after.throttled_swaps >= before.throttled_swaps + FRAMES - MAX_FRAMES_IN_FLIGHT - 1);
+
+    eglMakeCurrent(g_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroySurface(g_dpy, surface);
+    eglDestroyContext(g_dpy, ctx);
+}
+
+int main(void) {
+    egl_wrapper_initialize(STUB_EGL_PATH);
+    egl_wrapper_set_max_frames_in_flight(MAX_FRAMES_IN_FLIGHT);
+
+    g_dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    CHECK(eglInitialize(g_dpy, NULL, NULL) == EGL_TRUE);
+    EGLint num_config;
+    eglChooseConfig(g_dpy, NULL, &g_config, 1, &num_config);
+
+    run();
+    egl_wrapper_frame_limiter_stats stats;
+    egl_wrapper_get_frame_limiter_stats(&stats);
+    CHECK(stats.max_frames_in_flight == MAX_FRAMES_IN_FLIGHT);
+    CHECK(stats.throttled_swaps >= FRAMES - MAX_FRAMES_IN_FLIGHT - 1);
+    CHECK(stats.frames_in_flight <= MAX_FRAMES_IN_FLIGHT);
+
+    run_destroyed_surfaces();
+
+    egl_wrapper_enable_gpu_timing(true);
+    run();
+    return TEST_RESULT();
+}
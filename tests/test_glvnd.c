@@ -0,0 +1,84 @@
+// GLVND vendor mode: this program plays libglvnd, loading a vendor library
+// built with the egl-wrapper-glvnd glue and calling its __egl_Main. The
+// glue must initialize the real (stub) vendor, and hand out the wrapper's
+// functions for the EGL functions it implements, the real vendor's for
+// the others.
+//
+// This program is not linked to egl-wrapper, so it has its own CHECK.
+
+#define _GNU_SOURCE
+
+#include <glvnd/libeglabi.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Globals
+static int g_test_failures = 0;
+
+#define CHECK(condition) do { \
+    if(!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        g_test_failures++; \
+    } \
+} while(0)
+
+static void* load_symbol(void* library, const char* name) {
+    void* symbol = dlsym(library, name);
+    if(symbol == NULL) {
+        fprintf(stderr, "Missing %s\n", name);
+        exit(1);
+    }
+    return symbol;
+}
+
+int main(void) {
+    setenv("EGL_WRAPPER_GLVND_VENDOR", STUB_VENDOR_PATH, 1);
+    void* wrapper_vendor = dlopen(WRAPPER_VENDOR_PATH, RTLD_NOW | RTLD_LOCAL);
+    if(wrapper_vendor == NULL) {
+        fprintf(stderr, "Failed to load %s: %s\n", WRAPPER_VENDOR_PATH, dlerror());
+        return 1;
+    }
+    __PFNEGLMAINPROC egl_main = (__PFNEGLMAINPROC)load_symbol(wrapper_vendor, __EGL_MAIN_PROTO_NAME);
+
+    __EGLapiExports exports;
+    __EGLapiImports imports;
+    memset(&exports, 0, sizeof(exports));
+    memset(&imports, 0, sizeof(imports));
+    CHECK(egl_main(EGL_VENDOR_ABI_VERSION, &exports, NULL, &imports) == EGL_TRUE);
+    if(imports.getProcAddress == NULL) {
+        fprintf(stderr, "No getProcAddress import\n");
+        return 1;
+    }
+
+    void* stub_vendor = dlopen(STUB_VENDOR_PATH, RTLD_NOW | RTLD_NOLOAD);
+    CHECK(stub_vendor != NULL);
+    unsigned int (*main_calls)(void) = (unsigned int (*)(void))load_symbol(stub_vendor, "stub_glvnd_main_calls");
+    CHECK(main_calls() == 1);
+
+    // Functions egl-wrapper implements are its own, the others the stub's.
+    void* swap_buffers = imports.getProcAddress("eglSwapBuffers");
+    CHECK(swap_buffers != NULL && swap_buffers != dlsym(stub_vendor, "eglSwapBuffers"));
+    CHECK(imports.getProcAddress("stub_egl_set_gpu_time") == dlsym(stub_vendor, "stub_egl_set_gpu_time"));
+
+    // A frame through libglvnd's dispatch reaches the hook, then the stub.
+    EGLDisplay (*get_display)(EGLNativeDisplayType) = (EGLDisplay (*)(EGLNativeDisplayType))imports.getProcAddress("eglGetDisplay");
+    EGLBoolean (*initialize)(EGLDisplay, EGLint*, EGLint*) = (EGLBoolean (*)(EGLDisplay, EGLint*, EGLint*))imports.getProcAddress("eglInitialize");
+    EGLBoolean (*choose_config)(EGLDisplay, const EGLint*, EGLConfig*, EGLint, EGLint*) =
+        (EGLBoolean (*)(EGLDisplay, const EGLint*, EGLConfig*, EGLint, EGLint*))imports.getProcAddress("eglChooseConfig");
+    EGLSurface (*create_pbuffer)(EGLDisplay, EGLConfig, const EGLint*) = (EGLSurface (*)(EGLDisplay, EGLConfig, const EGLint*))imports.getProcAddress("eglCreatePbufferSurface");
+    EGLBoolean (*swap)(EGLDisplay, EGLSurface) = (EGLBoolean (*)(EGLDisplay, EGLSurface))swap_buffers;
+
+    EGLDisplay dpy = get_display(EGL_DEFAULT_DISPLAY);
+    CHECK(initialize(dpy, NULL, NULL) == EGL_TRUE);
+    EGLConfig config;
+    EGLint num_config;
+    choose_config(dpy, NULL, &config, 1, &num_config);
+    EGLSurface surface = create_pbuffer(dpy, config, NULL);
+    CHECK(swap(dpy, surface) == EGL_TRUE);
+
+    unsigned int (*hooked_swaps)(void) = (unsigned int (*)(void))load_symbol(wrapper_vendor, "test_glvnd_hooked_swaps");
+    CHECK(hooked_swaps() == 1);
+    return g_test_failures == 0 ? 0 : 1;
+}
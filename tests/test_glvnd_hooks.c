@@ -0,0 +1,27 @@
+// The vendor library loaded by test_glvnd: a hooks library built with the
+// egl-wrapper-glvnd glue, which wraps the stub vendor.
+
+#include "egl-wrapper.h"
+
+#include <stddef.h>
+
+// Globals
+static unsigned int g_hooked_swaps = 0;
+
+unsigned int test_glvnd_hooked_swaps(void) {
+    return g_hooked_swaps;
+}
+
+static EGLBoolean hooked_swap_buffers(EGLDisplay dpy, EGLSurface surface) {
+    g_hooked_swaps++;
+    return bare_eglSwapBuffers(dpy, surface);
+}
+
+void egl_wrapper_first_contact(const char* egl_fn_name) {
+    (void)egl_fn_name;
+    egl_wrapper_initialize(NULL);
+}
+
+static void __attribute__((constructor)) register_hooks(void) {
+    register_hook_eglSwapBuffers(hooked_swap_buffers);
+}
@@ -0,0 +1,135 @@
+// GPU timing: two threads render to their own surface, one GPU-bound and
+// one CPU-bound. The latency reported for each frame must match the
+// completion time scripted in the stub, and each surface must be
+// classified on its own.
+
+#include "test_common.h"
+
+#include <EGL/egl.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+#define FRAMES 10
+// How late the background thread may observe a completed fence, which
+// includes being scheduled late on a loaded machine.
+#define TOLERANCE_NS 10000000ull
+
+// Types
+typedef struct {
+    uint64_t gpu_ns;
+    uint64_t frame_period_ns;
+    EGLSurface surface;
+    // Filled from the timing callback, in completion order.
+    egl_wrapper_gpu_frame_info frames[FRAMES];
+    unsigned int num_frames;
+} render_thread;
+
+// Globals
+static EGLDisplay g_dpy;
+static render_thread g_threads[2] = {
+    // GPU-bound: each frame takes the GPU far longer than the thread
+    // takes to submit the next.
+    { .gpu_ns = 20000000ull, .frame_period_ns = 2000000ull },
+    // CPU-bound: the GPU is done long before the next frame.
+    { .gpu_ns = 1000000ull, .frame_period_ns = 10000000ull },
+};
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t g_surfaces_created;
+
+static void on_frame(const egl_wrapper_gpu_frame_info* info) {
+    pthread_mutex_lock(&g_lock);
+    for(unsigned int i = 0; i < 2; i++) {
+        render_thread* thread = &g_threads[i];
+        if(thread->surface == info->surface && thread->num_frames < FRAMES) {
+            thread->frames[thread->num_frames++] = *info;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+static void* render(void* arg) {
+    render_thread* thread = arg;
+    EGLConfig config;
+    EGLint num_config;
+    eglChooseConfig(g_dpy, NULL, &config, 1, &num_config);
+    EGLSurface surface = eglCreatePbufferSurface(g_dpy, config, NULL);
+    EGLContext ctx = eglCreateContext(g_dpy, config, EGL_NO_CONTEXT, NULL);
+    void (*set_gpu_time)(EGLSurface, uint64_t) =
+        (void (*)(EGLSurface, uint64_t))test_stub_symbol(STUB_EGL_PATH, "stub_egl_set_gpu_time");
+    set_gpu_time(surface, thread->gpu_ns);
+    pthread_mutex_lock(&g_lock);
+    thread->surface = surface;
+    pthread_mutex_unlock(&g_lock);
+    pthread_barrier_wait(&g_surfaces_created);
+
+    eglMakeCurrent(g_dpy, surface, surface, ctx);
+    for(unsigned int i = 0; i < FRAMES; i++) {
+        CHECK(eglSwapBuffers(g_dpy, surface) == EGL_TRUE);
+        test_sleep_ns(thread->frame_period_ns);
+    }
+    eglMakeCurrent(g_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    return NULL;
+}
+
+static void check_thread(const render_thread* thread) {
+    CHECK(thread->num_frames == FRAMES);
+    uint64_t expected_done = 0;
+    for(unsigned int i = 0; i < thread->num_frames; i++) {
+        const egl_wrapper_gpu_frame_info* info = &thread->frames[i];
+        // The stub runs each frame of a surface after the previous one.
+        uint64_t start = info->submit_ns > expected_done ? info->submit_ns : expected_done;
+        expected_done = start + thread->gpu_ns;
+        CHECK(info->complete_ns + 1000000ull >= expected_done);
+        CHECK(info->complete_ns <= expected_done + TOLERANCE_NS);
+        if(i > 0) {
+            CHECK(info->frame > thread->frames[i - 1].frame);
+        }
+    }
+}
+
+int main(void) {
+    egl_wrapper_initialize(STUB_EGL_PATH);
+    egl_wrapper_set_gpu_timing_callback(on_frame);
+    egl_wrapper_enable_gpu_timing(true);
+
+    g_dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    CHECK(eglInitialize(g_dpy, NULL, NULL) == EGL_TRUE);
+
+    pthread_barrier_init(&g_surfaces_created, NULL, 2);
+    pthread_t threads[2];
+    for(unsigned int i = 0; i < 2; i++) {
+        pthread_create(&threads[i], NULL, render, &g_threads[i]);
+    }
+    for(unsigned int i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Wait for the GPU-bound surface to drain.
+    egl_wrapper_gpu_timing_stats stats;
+    uint64_t deadline = test_now_ns() + 2000000000ull;
+    do {
+        test_sleep_ns(1000000ull);
+        egl_wrapper_get_gpu_timing_stats(&stats);
+    } while(stats.frames < 2 * FRAMES && test_now_ns() < deadline);
+
+    CHECK(stats.frames == 2 * FRAMES);
+    CHECK(stats.dropped_frames == 0);
+    pthread_mutex_lock(&g_lock);
+    check_thread(&g_threads[0]);
+    check_thread(&g_threads[1]);
+
+    // All but the last frame of the GPU-bound surface had the next frame
+    // queued behind them. The CPU-bound surface never had, however deep
+    // the other surface's queue was.
+    for(unsigned int i = 0; i < g_threads[0].num_frames; i++) {
+        CHECK(g_threads[0].frames[i].gpu_bound == (i + 1 < FRAMES));
+    }
+    for(unsigned int i = 0; i < g_threads[1].num_frames; i++) {
+        CHECK(!g_threads[1].frames[i].gpu_bound);
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    CHECK(stats.gpu_bound_frames == FRAMES - 1);
+    CHECK(stats.cpu_bound_frames == FRAMES + 1);
+    return TEST_RESULT();
+}
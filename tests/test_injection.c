@@ -0,0 +1,191 @@
+// Latency and failure injection: random decisions and delays must repeat
+// when the rules are loaded again, frame conditions must count the
+// thread's own successful swaps only (including those skipped by frame
+// decimation), and an error followed by another rule's error must still
+// get its recovery recorded.
+
+#include "test_common.h"
+
+#include <EGL/egl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RANDOM_CALLS 64
+#define DELAY_CALLS 16
+#define DELAY_RULES 5
+#define INJECTION_SEED "7"
+
+// Globals
+static EGLDisplay g_dpy;
+static EGLConfig g_config;
+static char g_rules_path[] = "/tmp/egl-wrapper-test-injection-XXXXXX";
+
+static void load_rules(const char* rules) {
+    FILE* file = fopen(g_rules_path, "w");
+    fputs(rules, file);
+    fclose(file);
+    CHECK(egl_wrapper_load_injection_rules(g_rules_path));
+}
+
+static uint64_t failed_calls(void) {
+    uint64_t failed = 0;
+    for(unsigned int i = 0; i < RANDOM_CALLS; i++) {
+        if(eglWaitClient() == EGL_FALSE) {
+            failed |= 1ull << i;
+        }
+    }
+    return failed;
+}
+
+static void* swap_frames(void* arg) {
+    // Threads start with the name of their creator.
+    pthread_setname_np(pthread_self(), "injection_other");
+    EGLSurface surface = eglCreatePbufferSurface(g_dpy, g_config, NULL);
+    EGLContext ctx = eglCreateContext(g_dpy, g_config, EGL_NO_CONTEXT, NULL);
+    eglMakeCurrent(g_dpy, surface, surface, ctx);
+    for(unsigned int i = 0; i < *(unsigned int*)arg; i++) {
+        eglSwapBuffers(g_dpy, surface);
+    }
+    eglMakeCurrent(g_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(g_dpy, ctx);
+    eglDestroySurface(g_dpy, surface);
+    return NULL;
+}
+
+// The injection report, as printed to stderr.
+static void read_report(char* report, size_t size) {
+    char path[] = "/tmp/egl-wrapper-test-report-XXXXXX";
+    int fd = mkstemp(path);
+    int saved_stderr = dup(STDERR_FILENO);
+    fflush(stderr);
+    dup2(fd, STDERR_FILENO);
+    egl_wrapper_print_injection_report();
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    ssize_t length = pread(fd, report, size - 1, 0);
+    report[length > 0 ? length : 0] = '\0';
+    close(fd);
+    unlink(path);
+}
+
+// The delay total of each rule in the report.
+static void read_delay_totals(double totals[DELAY_RULES]) {
+    char report[4096];
+    read_report(report, sizeof(report));
+    const char* p = report;
+    for(unsigned int i = 0; i < DELAY_RULES; i++) {
+        totals[i] = -1.0;
+        p = strstr(p, "calls injected, ");
+        if(p == NULL) {
+            return;
+        }
+        p += strlen("calls injected, ");
+        sscanf(p, "%lf", &totals[i]);
+    }
+}
+
+static void run_delays(EGLSurface surface, double totals[DELAY_RULES]) {
+    load_rules("eglWaitClient delay=100us\n"
+        "eglWaitGL delay=uniform:50us:150us\n"
+        "eglWaitNative delay=normal:100us:20us\n"
+        "eglBindAPI delay=exponential:100us\n"
+        "eglReleaseTexImage delay=1ms every=4\n");
+    for(unsigned int i = 0; i < DELAY_CALLS; i++) {
+        eglWaitClient();
+        eglWaitGL();
+        eglWaitNative(EGL_CORE_NATIVE_ENGINE);
+        eglBindAPI(EGL_OPENGL_ES_API);
+        eglReleaseTexImage(g_dpy, surface, EGL_BACK_BUFFER);
+    }
+    read_delay_totals(totals);
+}
+
+int main(void) {
+    // Read at initialization.
+    setenv("EGL_WRAPPER_INJECT_SEED", INJECTION_SEED, 1);
+    egl_wrapper_initialize(STUB_EGL_PATH);
+    g_dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    CHECK(eglInitialize(g_dpy, NULL, NULL) == EGL_TRUE);
+    EGLint num_config;
+    eglChooseConfig(g_dpy, NULL, &g_config, 1, &num_config);
+    int fd = mkstemp(g_rules_path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    // The same decisions for the same calls of a rule once the rules are
+    // loaded again, whichever calls of the rule were made before.
+    load_rules("eglWaitClient,eglWaitGL error=EGL_BAD_ALLOC probability=0.5\n");
+    uint64_t first = failed_calls();
+    CHECK(first != 0 && first != ~0ull);
+    for(unsigned int i = 0; i < 10; i++) {
+        eglWaitGL();
+    }
+    load_rules("eglWaitClient,eglWaitGL error=EGL_BAD_ALLOC probability=0.5\n");
+    CHECK(failed_calls() == first);
+
+    // Only this thread's successful swaps count.
+    pthread_setname_np(pthread_self(), "injection_main");
+    load_rules("eglSwapBuffers error=EGL_BAD_ALLOC count=3 threads=injection_main\n"
+        "eglWaitClient error=EGL_BAD_ACCESS after_frames=2\n");
+    unsigned int other_frames = 5;
+    pthread_t thread;
+    pthread_create(&thread, NULL, swap_frames, &other_frames);
+    pthread_join(thread, NULL);
+
+    EGLSurface surface = eglCreatePbufferSurface(g_dpy, g_config, NULL);
+    EGLContext ctx = eglCreateContext(g_dpy, g_config, EGL_NO_CONTEXT, NULL);
+    eglMakeCurrent(g_dpy, surface, surface, ctx);
+    CHECK(eglWaitClient() == EGL_TRUE);
+    unsigned int failed_swaps = 0;
+    for(unsigned int i = 0; i < 4; i++) {
+        failed_swaps += eglSwapBuffers(g_dpy, surface) == EGL_FALSE;
+    }
+    CHECK(failed_swaps == 3);
+    CHECK(eglWaitClient() == EGL_TRUE);
+    CHECK(eglSwapBuffers(g_dpy, surface) == EGL_TRUE);
+    CHECK(eglWaitClient() == EGL_FALSE);
+    CHECK(eglGetError() == EGL_BAD_ACCESS);
+
+    // Swaps skipped by decimation count as frames too. This thread made 2
+    // successful swaps so far.
+    egl_wrapper_set_frame_decimation(2, 0.0);
+    load_rules("eglWaitClient error=EGL_BAD_ACCESS after_frames=6\n");
+    for(unsigned int i = 0; i < 3; i++) {
+        CHECK(eglSwapBuffers(g_dpy, surface) == EGL_TRUE);
+    }
+    CHECK(eglWaitClient() == EGL_TRUE);
+    CHECK(eglSwapBuffers(g_dpy, surface) == EGL_TRUE);
+    CHECK(eglWaitClient() == EGL_FALSE);
+    egl_wrapper_set_frame_decimation(1, 0.0);
+
+    // Each kind of delay adds up to the same total in a run with the
+    // same seed.
+    double totals[DELAY_RULES], again[DELAY_RULES];
+    run_delays(surface, totals);
+    CHECK(totals[0] == DELAY_CALLS * 0.1);
+    CHECK(totals[1] >= DELAY_CALLS * 0.05 && totals[1] <= DELAY_CALLS * 0.15);
+    CHECK(totals[2] > 0.0 && totals[3] > 0.0);
+    CHECK(totals[4] == DELAY_CALLS / 4 * 1.0);
+    run_delays(surface, again);
+    CHECK(memcmp(totals, again, sizeof(totals)) == 0);
+
+    // Both errors recover: the first when the second replaces it.
+    load_rules("eglWaitClient error=EGL_BAD_ALLOC count=1\n"
+        "eglWaitGL error=EGL_BAD_ACCESS count=1\n");
+    CHECK(eglWaitClient() == EGL_FALSE);
+    CHECK(eglWaitGL() == EGL_FALSE);
+    CHECK(eglSwapBuffers(g_dpy, surface) == EGL_TRUE);
+    char report[4096];
+    read_report(report, sizeof(report));
+    const char* recovered = strstr(report, "recovered 1 time(s)");
+    CHECK(recovered != NULL && strstr(recovered + 1, "recovered 1 time(s)") != NULL);
+
+    egl_wrapper_load_injection_rules(NULL);
+    eglMakeCurrent(g_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(g_dpy, ctx);
+    eglDestroySurface(g_dpy, surface);
+    unlink(g_rules_path);
+    return TEST_RESULT();
+}
@@ -0,0 +1,17 @@
+// A hook plugin for test_plugins. It reports to functions exported by the
+// test program.
+
+#include "egl-wrapper.h"
+
+void test_plugin_loaded(void);
+void test_plugin_swapped(void);
+
+static EGLBoolean plugin_swap_buffers(EGLDisplay dpy, EGLSurface surface) {
+    test_plugin_swapped();
+    return bare_eglSwapBuffers(dpy, surface);
+}
+
+void egl_wrapper_plugin_init(egl_wrapper_plugin_hooks* hooks) {
+    hooks->eglSwapBuffers = plugin_swap_buffers;
+    test_plugin_loaded();
+}
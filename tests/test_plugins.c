@@ -0,0 +1,172 @@
+// Hook plugins: loading a plugin must not replace the application's hooks
+// for good, and unloading it must bring them back. Plugins listed in the
+// config file must be watched, following the config file as it changes.
+// Calls made while a plugin is reloaded reach either the old or the new
+// plugin.
+
+#include "test_common.h"
+
+#include <EGL/egl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+// Globals
+static _Atomic unsigned int g_plugin_loads = 0;
+static _Atomic unsigned int g_plugin_swaps = 0;
+static _Atomic unsigned int g_app_swaps = 0;
+static unsigned int g_app_query_apis = 0;
+static char g_dir[] = "/tmp/egl-wrapper-test-plugins-XXXXXX";
+static EGLDisplay g_dpy;
+static EGLSurface g_surface;
+static _Atomic bool g_swapping = true;
+
+void test_plugin_loaded(void) {
+    g_plugin_loads++;
+}
+
+void test_plugin_swapped(void) {
+    g_plugin_swaps++;
+}
+
+static EGLBoolean app_swap_buffers(EGLDisplay dpy, EGLSurface surface) {
+    g_app_swaps++;
+    return bare_eglSwapBuffers(dpy, surface);
+}
+
+static EGLenum app_query_api(void) {
+    g_app_query_apis++;
+    return bare_eglQueryAPI();
+}
+
+static void copy_file(const char* from, const char* to) {
+    FILE* in = fopen(from, "rb");
+    FILE* out = fopen(to, "wb");
+    CHECK(in != NULL && out != NULL);
+    char buffer[65536];
+    size_t n;
+    while(in != NULL && out != NULL && (n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        fwrite(buffer, 1, n, out);
+    }
+    if(in != NULL) {
+        fclose(in);
+    }
+    if(out != NULL) {
+        fclose(out);
+    }
+}
+
+static void write_config(const char* path, const char* plugin_path) {
+    FILE* config = fopen(path, "w");
+    fprintf(config, "# test plugins\n%s\n", plugin_path);
+    fclose(config);
+}
+
+// Wait for the watch thread to reload the plugins.
+static bool wait_for_loads(unsigned int loads) {
+    uint64_t deadline = test_now_ns() + 5000000000ull;
+    while(g_plugin_loads < loads && test_now_ns() < deadline) {
+        test_sleep_ns(10000000ull);
+    }
+    // Let the reload finish after the plugin's init.
+    test_sleep_ns(50000000ull);
+    return g_plugin_loads == loads;
+}
+
+static void* swap_loop(void* arg) {
+    unsigned int* swaps = arg;
+    while(g_swapping) {
+        eglSwapBuffers(g_dpy, g_surface);
+        (*swaps)++;
+    }
+    return NULL;
+}
+
+// Swap on another thread while the plugin is reloaded over and over.
+static void reload_while_swapping(void) {
+    unsigned int plugin_swaps = g_plugin_swaps;
+    unsigned int app_swaps = g_app_swaps;
+    unsigned int swaps = 0;
+    pthread_t thread;
+    pthread_create(&thread, NULL, swap_loop, &swaps);
+    for(unsigned int i = 0; i < 50; i++) {
+        egl_wrapper_reload_plugins();
+    }
+    g_swapping = false;
+    pthread_join(thread, NULL);
+
+    CHECK(swaps > 0);
+    CHECK(g_plugin_swaps - plugin_swaps == swaps);
+    CHECK(g_app_swaps == app_swaps);
+}
+
+int main(void) {
+    egl_wrapper_initialize(STUB_EGL_PATH);
+    register_hook_eglSwapBuffers(app_swap_buffers);
+    register_hook_eglQueryAPI(app_query_api);
+
+    EGLDisplay dpy = g_dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    CHECK(eglInitialize(dpy, NULL, NULL) == EGL_TRUE);
+    EGLConfig config;
+    EGLint num_config;
+    eglChooseConfig(dpy, NULL, &config, 1, &num_config);
+    EGLSurface surface = g_surface = eglCreatePbufferSurface(dpy, config, NULL);
+
+    // The plugin hooks eglSwapBuffers only.
+    egl_wrapper_load_plugins(TEST_PLUGIN_PATH, NULL, false);
+    CHECK(g_plugin_loads == 1);
+    eglSwapBuffers(dpy, surface);
+    eglQueryAPI();
+    CHECK(g_plugin_swaps == 1 && g_app_swaps == 0);
+    CHECK(g_app_query_apis == 1);
+
+    unsigned int loads = g_plugin_loads;
+    reload_while_swapping();
+    CHECK(g_plugin_loads > loads);
+    unsigned int plugin_swaps = g_plugin_swaps;
+
+    egl_wrapper_load_plugins(NULL, NULL, false);
+    eglSwapBuffers(dpy, surface);
+    CHECK(g_plugin_swaps == plugin_swaps && g_app_swaps == 1);
+
+    // Plugins of the config file are watched, also once the config file
+    // lists other ones.
+    CHECK(mkdtemp(g_dir) != NULL);
+    char config_path[256], first_path[256], second_path[256];
+    snprintf(config_path, sizeof(config_path), "%s/plugins.conf", g_dir);
+    snprintf(first_path, sizeof(first_path), "%s/first.so", g_dir);
+    snprintf(second_path, sizeof(second_path), "%s/second.so", g_dir);
+    copy_file(TEST_PLUGIN_PATH, first_path);
+    copy_file(TEST_PLUGIN_PATH, second_path);
+    write_config(config_path, first_path);
+
+    loads = g_plugin_loads;
+    egl_wrapper_load_plugins(NULL, config_path, true);
+    CHECK(g_plugin_loads == ++loads);
+    test_sleep_ns(50000000ull);
+
+    copy_file(TEST_PLUGIN_PATH, first_path);
+    CHECK(wait_for_loads(++loads));
+
+    write_config(config_path, second_path);
+    CHECK(wait_for_loads(++loads));
+
+    copy_file(TEST_PLUGIN_PATH, second_path);
+    CHECK(wait_for_loads(++loads));
+
+    // The first plugin isn't listed anymore.
+    copy_file(TEST_PLUGIN_PATH, first_path);
+    test_sleep_ns(300000000ull);
+    CHECK(g_plugin_loads == loads);
+
+    eglSwapBuffers(dpy, surface);
+    CHECK(g_plugin_swaps == plugin_swaps + 1 && g_app_swaps == 1);
+
+    unlink(config_path);
+    unlink(first_path);
+    unlink(second_path);
+    rmdir(g_dir);
+    return TEST_RESULT();
+}
@@ -0,0 +1,211 @@
+// Redundant-call analysis: only back-to-back eglGetError polls returning
+// EGL_SUCCESS are redundant, any other EGL call in between breaks them.
+// Each other kind of redundant call is detected, attributed to the call
+// site it comes from, and the time spent in it is accounted as wasted.
+
+#include "test_common.h"
+
+#include <EGL/egl.h>
+#include <string.h>
+
+// Time taken by the eglQuerySurface hook.
+#define QUERY_NS 10000000ull
+
+// Globals
+static EGLDisplay g_dpy;
+static EGLConfig g_config;
+static egl_wrapper_redundancy_frame g_last_frame;
+
+static unsigned long long redundant(egl_wrapper_redundant_call kind) {
+    egl_wrapper_redundancy_stats stats;
+    egl_wrapper_get_redundancy_stats(&stats);
+    return stats.redundant[kind];
+}
+
+static unsigned long long redundant_get_errors(void) {
+    return redundant(EGL_WRAPPER_REDUNDANT_GET_ERROR);
+}
+
+static EGLBoolean slow_query_surface(EGLDisplay dpy, EGLSurface surface, EGLint attribute, EGLint* value) {
+    test_sleep_ns(QUERY_NS);
+    return bare_eglQuerySurface(dpy, surface, attribute, value);
+}
+
+static void frame_done(const egl_wrapper_redundancy_frame* frame) {
+    g_last_frame = *frame;
+}
+
+// Two call sites of eglGetConfigAttrib. The value is used after the call
+// so that it isn't a tail call, which would attribute it to the caller.
+__attribute__((noinline)) EGLint config_attrib_site_a(void) {
+    EGLint value = -1;
+    eglGetConfigAttrib(g_dpy, g_config, EGL_RED_SIZE, &value);
+    return value;
+}
+
+__attribute__((noinline)) EGLint config_attrib_site_b(void) {
+    EGLint value = -1;
+    eglGetConfigAttrib(g_dpy, g_config, EGL_RED_SIZE, &value);
+    return value;
+}
+
+static const char* site_function(void* call_site) {
+    Dl_info info;
+    return dladdr(call_site, &info) != 0 && info.dli_sname != NULL ? info.dli_sname : "";
+}
+
+static void check_get_error(void) {
+    eglGetError();
+    eglGetError();
+    eglGetError();
+    CHECK(redundant_get_errors() == 2);
+
+    eglQueryAPI();
+    eglGetError();
+    CHECK(redundant_get_errors() == 2);
+
+    eglBindAPI(EGL_OPENGL_ES_API);
+    eglGetError();
+    eglGetCurrentContext();
+    eglGetError();
+    CHECK(redundant_get_errors() == 2);
+
+    eglGetError();
+    CHECK(redundant_get_errors() == 3);
+}
+
+static void check_other_kinds(void) {
+    EGLSurface surface = eglCreatePbufferSurface(g_dpy, g_config, NULL);
+    EGLSurface other = eglCreatePbufferSurface(g_dpy, g_config, NULL);
+    EGLContext ctx = eglCreateContext(g_dpy, g_config, EGL_NO_CONTEXT, NULL);
+
+    // The same binding again, then another one.
+    eglMakeCurrent(g_dpy, surface, surface, ctx);
+    eglMakeCurrent(g_dpy, surface, surface, ctx);
+    CHECK(redundant(EGL_WRAPPER_REDUNDANT_MAKE_CURRENT) == 1);
+    eglMakeCurrent(g_dpy, other, other, ctx);
+    eglMakeCurrent(g_dpy, surface, surface, ctx);
+    CHECK(redundant(EGL_WRAPPER_REDUNDANT_MAKE_CURRENT) == 1);
+
+    // Surface queries are only redundant within a frame.
+    EGLint width;
+    eglQuerySurface(g_dpy, surface, EGL_WIDTH, &width);
+    eglQuerySurface(g_dpy, surface, EGL_WIDTH, &width);
+    eglQuerySurface(g_dpy, surface, EGL_HEIGHT, &width);
+    eglQuerySurface(g_dpy, other, EGL_WIDTH, &width);
+    CHECK(redundant(EGL_WRAPPER_REDUNDANT_QUERY_SURFACE) == 1);
+    eglSwapBuffers(g_dpy, surface);
+    eglQuerySurface(g_dpy, surface, EGL_WIDTH, &width);
+    CHECK(redundant(EGL_WRAPPER_REDUNDANT_QUERY_SURFACE) == 1);
+
+    // Config attributes stay redundant across frames.
+    EGLint value;
+    eglGetConfigAttrib(g_dpy, g_config, EGL_BLUE_SIZE, &value);
+    eglGetConfigAttrib(g_dpy, g_config, EGL_GREEN_SIZE, &value);
+    eglSwapBuffers(g_dpy, surface);
+    eglGetConfigAttrib(g_dpy, g_config, EGL_BLUE_SIZE, &value);
+    CHECK(redundant(EGL_WRAPPER_REDUNDANT_GET_CONFIG_ATTRIB) == 1);
+
+    eglGetProcAddress("eglCreateSyncKHR");
+    eglGetProcAddress("eglDestroySyncKHR");
+    eglGetProcAddress("eglCreateSyncKHR");
+    CHECK(redundant(EGL_WRAPPER_REDUNDANT_GET_PROC_ADDRESS) == 1);
+
+    // The interval set for the current draw surface again.
+    eglSwapInterval(g_dpy, 1);
+    eglSwapInterval(g_dpy, 1);
+    CHECK(redundant(EGL_WRAPPER_REDUNDANT_SWAP_INTERVAL) == 1);
+    eglSwapInterval(g_dpy, 0);
+    eglMakeCurrent(g_dpy, other, other, ctx);
+    eglSwapInterval(g_dpy, 0);
+    CHECK(redundant(EGL_WRAPPER_REDUNDANT_SWAP_INTERVAL) == 1);
+
+    eglMakeCurrent(g_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(g_dpy, ctx);
+    eglDestroySurface(g_dpy, other);
+    eglDestroySurface(g_dpy, surface);
+}
+
+static void check_call_sites(void) {
+    config_attrib_site_a();
+    config_attrib_site_a();
+    config_attrib_site_a();
+    config_attrib_site_b();
+
+    egl_wrapper_redundancy_site sites[64];
+    unsigned int num_sites = egl_wrapper_get_redundancy_sites(sites, 64);
+    bool found_a = false, found_b = false;
+    for(unsigned int i = 0; i < num_sites; i++) {
+        const char* function = site_function(sites[i].call_site);
+        if(strcmp(function, "config_attrib_site_a") == 0) {
+            CHECK(!found_a);
+            found_a = true;
+            CHECK(sites[i].kind == EGL_WRAPPER_REDUNDANT_GET_CONFIG_ATTRIB);
+            CHECK(sites[i].calls == 3 && sites[i].redundant == 2);
+        } else if(strcmp(function, "config_attrib_site_b") == 0) {
+            CHECK(!found_b);
+            found_b = true;
+            CHECK(sites[i].calls == 1 && sites[i].redundant == 1);
+        }
+    }
+    CHECK(found_a && found_b);
+}
+
+// Only the time of redundant calls is wasted, in the totals, in the
+// frame summary and at the call site.
+static void check_wasted_time(void) {
+    register_hook_eglQuerySurface(slow_query_surface);
+    egl_wrapper_set_redundancy_frame_callback(frame_done);
+    EGLSurface surface = eglCreatePbufferSurface(g_dpy, g_config, NULL);
+    // Start from a new frame.
+    eglSwapBuffers(g_dpy, surface);
+
+    egl_wrapper_redundancy_stats before;
+    egl_wrapper_get_redundancy_stats(&before);
+    // All from the same call site.
+    const EGLint attributes[] = { EGL_WIDTH, EGL_WIDTH, EGL_HEIGHT };
+    for(unsigned int i = 0; i < 3; i++) {
+        EGLint value;
+        eglQuerySurface(g_dpy, surface, attributes[i], &value);
+    }
+    eglSwapBuffers(g_dpy, surface);
+
+    egl_wrapper_redundancy_stats after;
+    egl_wrapper_get_redundancy_stats(&after);
+    unsigned long long wasted = after.wasted_ns[EGL_WRAPPER_REDUNDANT_QUERY_SURFACE] -
+        before.wasted_ns[EGL_WRAPPER_REDUNDANT_QUERY_SURFACE];
+    CHECK(wasted >= QUERY_NS && wasted < 2 * QUERY_NS);
+    CHECK(after.total_wasted_ns - before.total_wasted_ns == wasted);
+    CHECK(g_last_frame.redundant[EGL_WRAPPER_REDUNDANT_QUERY_SURFACE] == 1);
+    CHECK(g_last_frame.calls[EGL_WRAPPER_REDUNDANT_QUERY_SURFACE] == 3);
+    CHECK(g_last_frame.wasted_ns == wasted);
+    CHECK(after.worst_frame == g_last_frame.frame && after.worst_frame_wasted_ns == wasted);
+
+    // The sites are sorted by time wasted, so this one comes first.
+    egl_wrapper_redundancy_site site;
+    CHECK(egl_wrapper_get_redundancy_sites(&site, 1) == 1);
+    CHECK(site.kind == EGL_WRAPPER_REDUNDANT_QUERY_SURFACE);
+    CHECK(site.calls == 3 && site.redundant == 1);
+    CHECK(site.wasted_ns == wasted && site.total_ns >= 3 * QUERY_NS);
+
+    egl_wrapper_set_redundancy_frame_callback(NULL);
+    register_hook_eglQuerySurface(NULL);
+    eglDestroySurface(g_dpy, surface);
+}
+
+int main(void) {
+    egl_wrapper_initialize(STUB_EGL_PATH);
+    egl_wrapper_enable_redundancy_analysis(true);
+
+    check_get_error();
+
+    g_dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    CHECK(eglInitialize(g_dpy, NULL, NULL) == EGL_TRUE);
+    EGLint num_config;
+    eglChooseConfig(g_dpy, NULL, &g_config, 1, &num_config);
+
+    check_other_kinds();
+    check_call_sites();
+    check_wasted_time();
+    return TEST_RESULT();
+}
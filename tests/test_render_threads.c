@@ -0,0 +1,74 @@
+// Render thread policy: more render threads than can be recorded are
+// alive at once. All of them must get the policy, and their records must
+// be gone once they exited.
+
+#include "test_common.h"
+
+#include <EGL/egl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+// More than the wrapper records (64).
+#define THREADS 70
+#define RECORDED_THREADS 64
+#define NICE 3
+
+// Globals
+static EGLDisplay g_dpy;
+static EGLConfig g_config;
+static pthread_barrier_t g_all_current;
+static pthread_barrier_t g_checked;
+static int g_nice[THREADS];
+
+static void* render(void* arg) {
+    int* nice_level = arg;
+    EGLContext ctx = eglCreateContext(g_dpy, g_config, EGL_NO_CONTEXT, NULL);
+    CHECK(eglMakeCurrent(g_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx) == EGL_TRUE);
+    *nice_level = getpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid));
+    pthread_barrier_wait(&g_all_current);
+    pthread_barrier_wait(&g_checked);
+    eglMakeCurrent(g_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(g_dpy, ctx);
+    return NULL;
+}
+
+int main(void) {
+    egl_wrapper_initialize(STUB_EGL_PATH);
+    egl_wrapper_render_thread_policy policy = {
+        .cpus = NULL,
+        .set_nice = true,
+        .nice = NICE,
+        .sched_policy = EGL_WRAPPER_SCHED_UNCHANGED,
+        .sched_priority = 0
+    };
+    egl_wrapper_set_render_thread_policy(&policy);
+
+    g_dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    CHECK(eglInitialize(g_dpy, NULL, NULL) == EGL_TRUE);
+    EGLint num_config;
+    eglChooseConfig(g_dpy, NULL, &g_config, 1, &num_config);
+
+    pthread_barrier_init(&g_all_current, NULL, THREADS + 1);
+    pthread_barrier_init(&g_checked, NULL, THREADS + 1);
+    pthread_t threads[THREADS];
+    for(unsigned int i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, render, &g_nice[i]);
+    }
+    pthread_barrier_wait(&g_all_current);
+
+    for(unsigned int i = 0; i < THREADS; i++) {
+        CHECK(g_nice[i] == NICE);
+    }
+    egl_wrapper_render_thread_info infos[THREADS];
+    CHECK(egl_wrapper_get_render_threads(infos, THREADS) == RECORDED_THREADS);
+
+    pthread_barrier_wait(&g_checked);
+    for(unsigned int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    CHECK(egl_wrapper_get_render_threads(infos, THREADS) == 0);
+    return TEST_RESULT();
+}
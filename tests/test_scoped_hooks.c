@@ -0,0 +1,106 @@
+// Scoped hooks: a render thread made its context current and called EGL
+// before any scoped hooks existed, so it isn't registered. Hooks scoped to
+// its context, then to the thread itself, must still apply to its next
+// calls, and to no other thread's. Finding its binding must not clear the
+// error its first eglGetError returns. eglReleaseThread ends the scope of
+// the context which was current.
+
+#include "test_common.h"
+
+#include <EGL/egl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// Globals
+static EGLDisplay g_dpy;
+static EGLConfig g_config;
+static EGLContext g_render_ctx;
+static pid_t g_render_tid;
+static pthread_barrier_t g_step;
+static unsigned int g_context_swaps = 0;
+static unsigned int g_thread_swaps = 0;
+
+static EGLBoolean context_swap_buffers(EGLDisplay dpy, EGLSurface surface) {
+    g_context_swaps++;
+    return bare_eglSwapBuffers(dpy, surface);
+}
+
+static EGLBoolean thread_swap_buffers(EGLDisplay dpy, EGLSurface surface) {
+    g_thread_swaps++;
+    return bare_eglSwapBuffers(dpy, surface);
+}
+
+static void* render(void* arg) {
+    (void)arg;
+    g_render_tid = (pid_t)syscall(SYS_gettid);
+    EGLSurface surface = eglCreatePbufferSurface(g_dpy, g_config, NULL);
+    g_render_ctx = eglCreateContext(g_dpy, g_config, EGL_NO_CONTEXT, NULL);
+    eglMakeCurrent(g_dpy, surface, surface, g_render_ctx);
+    eglSwapBuffers(g_dpy, surface);
+    CHECK(eglSwapBuffers(g_dpy, EGL_NO_SURFACE) == EGL_FALSE);
+    pthread_barrier_wait(&g_step);
+
+    // The context scope was registered.
+    pthread_barrier_wait(&g_step);
+    CHECK(eglGetError() == EGL_BAD_SURFACE);
+    eglSwapBuffers(g_dpy, surface);
+    pthread_barrier_wait(&g_step);
+
+    // The thread scope was registered, the context scope removed.
+    pthread_barrier_wait(&g_step);
+    eglSwapBuffers(g_dpy, surface);
+
+    eglMakeCurrent(g_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(g_dpy, g_render_ctx);
+    eglDestroySurface(g_dpy, surface);
+    return NULL;
+}
+
+int main(void) {
+    egl_wrapper_initialize(STUB_EGL_PATH);
+    g_dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    CHECK(eglInitialize(g_dpy, NULL, NULL) == EGL_TRUE);
+    EGLint num_config;
+    eglChooseConfig(g_dpy, NULL, &g_config, 1, &num_config);
+
+    EGLSurface surface = eglCreatePbufferSurface(g_dpy, g_config, NULL);
+    EGLContext ctx = eglCreateContext(g_dpy, g_config, EGL_NO_CONTEXT, NULL);
+    eglMakeCurrent(g_dpy, surface, surface, ctx);
+
+    pthread_barrier_init(&g_step, NULL, 2);
+    pthread_t thread;
+    pthread_create(&thread, NULL, render, NULL);
+    pthread_barrier_wait(&g_step);
+    CHECK(g_context_swaps == 0 && g_thread_swaps == 0);
+
+    egl_wrapper_plugin_hooks context_hooks = { .eglSwapBuffers = context_swap_buffers };
+    CHECK(egl_wrapper_register_scoped_hooks(EGL_WRAPPER_SCOPE_CONTEXT, g_render_ctx, &context_hooks));
+    pthread_barrier_wait(&g_step);
+    pthread_barrier_wait(&g_step);
+    CHECK(g_context_swaps == 1);
+
+    // Not on this thread, with another context current.
+    eglSwapBuffers(g_dpy, surface);
+    CHECK(g_context_swaps == 1);
+
+    egl_wrapper_plugin_hooks thread_hooks = { .eglSwapBuffers = thread_swap_buffers };
+    CHECK(egl_wrapper_register_scoped_hooks(EGL_WRAPPER_SCOPE_THREAD, (void*)(intptr_t)g_render_tid, &thread_hooks));
+    egl_wrapper_unregister_scoped_hooks(EGL_WRAPPER_SCOPE_CONTEXT, g_render_ctx);
+    pthread_barrier_wait(&g_step);
+    pthread_join(thread, NULL);
+    CHECK(g_context_swaps == 1 && g_thread_swaps == 1);
+
+    eglSwapBuffers(g_dpy, surface);
+    CHECK(g_thread_swaps == 1);
+    egl_wrapper_unregister_scoped_hooks(EGL_WRAPPER_SCOPE_THREAD, (void*)(intptr_t)g_render_tid);
+
+    CHECK(egl_wrapper_register_scoped_hooks(EGL_WRAPPER_SCOPE_CONTEXT, ctx, &context_hooks));
+    eglSwapBuffers(g_dpy, surface);
+    CHECK(g_context_swaps == 2);
+    CHECK(eglReleaseThread() == EGL_TRUE);
+    eglSwapBuffers(g_dpy, surface);
+    CHECK(g_context_swaps == 2);
+    egl_wrapper_unregister_scoped_hooks(EGL_WRAPPER_SCOPE_CONTEXT, ctx);
+    return TEST_RESULT();
+}